@@ -0,0 +1,335 @@
+"""
+Automation 2040 W Firmware Core
+===============================
+
+Command handling shared by the USB serial and WiFi firmwares, so both
+expose identical semantics and run the same hot path.
+
+The core owns:
+- I/O state (relay and output states are read back from the hardware,
+  never shadowed in Python lists)
+- Validation of channel indices and values
+- Status encoding (dict, and allocation-free JSON via status_json)
+- Timed actions (e.g. "RELAY 1 ON 500" switches back off after 500 ms)
+- The text command protocol (see execute())
+
+Deployed compiled to .mpy by the firmware flash scripts when mpy-cross
+is available (make mpy).
+"""
+
+import time
+from array import array
+
+from automation import SWITCH_A, SWITCH_B
+from status_json import StatusEncoder
+
+
+class CommandError(Exception):
+    """Invalid command, index or value. The message is sent as ERR <message>."""
+
+    pass
+
+
+def parse_state(text):
+    """Parse an ON/OFF style state (case-insensitive) into a bool."""
+    return text.upper() in ("ON", "1", "TRUE", "HIGH")
+
+
+def parse_output(text):
+    """
+    Parse an output value: ON/OFF or a 0-100 percentage.
+
+    Returns:
+        Output value 0.0-1.0 (clamped)
+    """
+    text = text.upper()
+    if text in ("ON", "TRUE", "HIGH"):
+        return 1.0
+    if text in ("OFF", "FALSE", "LOW"):
+        return 0.0
+    return max(0.0, min(1.0, float(text) / 100.0))
+
+
+class AutomationCore:
+    """I/O state, validation, status and command protocol for one board."""
+
+    def __init__(self, board, version):
+        """
+        Args:
+            board: Automation2040W or Automation2040WMini instance
+            version: Firmware version string reported by VERSION
+        """
+        self.board = board
+        self.version = version
+        self.num_relays = board.NUM_RELAYS
+        self.num_outputs = board.NUM_OUTPUTS
+        self.num_inputs = board.NUM_INPUTS
+        self.num_adcs = board.NUM_ADCS
+
+        # Timed actions: deadline (ticks_ms) and value to restore, per channel
+        self._relay_deadline = [None] * self.num_relays
+        self._relay_restore = [False] * self.num_relays
+        self._output_deadline = [None] * self.num_outputs
+        self._output_restore = [0.0] * self.num_outputs
+
+        # Integer copy of each output as set through the core (0-1000), so
+        # the status encoder never has to box a float from board.output()
+        self.output_permille = array("H", [0] * self.num_outputs)
+        self.encoder = StatusEncoder(self)
+
+        # Called with no arguments after reset(), which also clears the
+        # switch LEDs (the WiFi firmware re-lights its link indicators)
+        self.on_reset = None
+
+    # ------------------------------------------------------------------
+    # Validation
+
+    def check_relay(self, index):
+        if not 0 <= index < self.num_relays:
+            raise CommandError(f"Relay index out of range (1-{self.num_relays})")
+
+    def check_output(self, index):
+        if not 0 <= index < self.num_outputs:
+            raise CommandError(f"Output index out of range (1-{self.num_outputs})")
+
+    def check_input(self, index):
+        if not 0 <= index < self.num_inputs:
+            raise CommandError(f"Input index out of range (1-{self.num_inputs})")
+
+    def check_adc(self, index):
+        if not 0 <= index < self.num_adcs:
+            raise CommandError(f"ADC index out of range (1-{self.num_adcs})")
+
+    # ------------------------------------------------------------------
+    # I/O state (0-based indices)
+
+    def relay(self, index):
+        """Return the state of relay `index` as read from the hardware."""
+        self.check_relay(index)
+        if self.num_relays > 1:
+            return bool(self.board.relay(index))
+        return bool(self.board.relay())
+
+    def set_relay(self, index, state, duration_ms=0):
+        """
+        Switch a relay.
+
+        Args:
+            index: Relay index (0-based)
+            state: True for on
+            duration_ms: If non-zero, restore the previous state after this long
+        """
+        self.check_relay(index)
+        if duration_ms:
+            if self._relay_deadline[index] is None:  # Extending keeps the original value
+                self._relay_restore[index] = self.relay(index)
+            self._relay_deadline[index] = time.ticks_add(time.ticks_ms(), duration_ms)
+        else:
+            self._relay_deadline[index] = None
+        if self.num_relays > 1:
+            self.board.relay(index, state)
+        else:
+            self.board.relay(state)
+
+    def toggle_relay(self, index):
+        state = not self.relay(index)
+        self.set_relay(index, state)
+        return state
+
+    def output(self, index):
+        """Return the value of output `index` (0.0-1.0)."""
+        self.check_output(index)
+        return self.board.output(index)
+
+    def set_output(self, index, value, duration_ms=0):
+        """
+        Set an output.
+
+        Args:
+            index: Output index (0-based)
+            value: 0.0-1.0 (clamped)
+            duration_ms: If non-zero, restore the previous value after this long
+        """
+        self.check_output(index)
+        value = max(0.0, min(1.0, value))
+        self.output_permille[index] = int(value * 1000 + 0.5)
+        if duration_ms:
+            if self._output_deadline[index] is None:  # Extending keeps the original value
+                self._output_restore[index] = self.output(index)
+            self._output_deadline[index] = time.ticks_add(time.ticks_ms(), duration_ms)
+        else:
+            self._output_deadline[index] = None
+        self.board.output(index, value)
+
+    def toggle_output(self, index):
+        value = 0.0 if self.output(index) > 0 else 1.0
+        self.set_output(index, value)
+        return value
+
+    def read_input(self, index):
+        self.check_input(index)
+        return bool(self.board.read_input(index))
+
+    def read_adc(self, index):
+        self.check_adc(index)
+        return self.board.read_adc(index)
+
+    def reset(self):
+        """Reset the board to its safe state and cancel timed actions."""
+        self.board.reset()
+        for i in range(self.num_relays):
+            self._relay_deadline[i] = None
+        for i in range(self.num_outputs):
+            self._output_deadline[i] = None
+            self.output_permille[i] = 0
+        if self.on_reset:
+            self.on_reset()
+
+    def tick(self, now=None):
+        """Expire timed actions. Call regularly from the main loop."""
+        if now is None:
+            now = time.ticks_ms()
+        for i in range(self.num_relays):
+            deadline = self._relay_deadline[i]
+            if deadline is not None and time.ticks_diff(now, deadline) >= 0:
+                self.set_relay(i, self._relay_restore[i])
+        for i in range(self.num_outputs):
+            deadline = self._output_deadline[i]
+            if deadline is not None and time.ticks_diff(now, deadline) >= 0:
+                self.set_output(i, self._output_restore[i])
+
+    # ------------------------------------------------------------------
+    # Status
+
+    def status(self):
+        """Return all I/O states as a dict (outputs in percent)."""
+        return {
+            "relays": [self.relay(i) for i in range(self.num_relays)],
+            "outputs": [round(self.board.output(i) * 100, 1) for i in range(self.num_outputs)],
+            "inputs": [bool(self.board.read_input(i)) for i in range(self.num_inputs)],
+            "adcs": [round(self.board.read_adc(i), 3) for i in range(self.num_adcs)],
+            "buttons": {
+                "a": self.board.switch_pressed(SWITCH_A),
+                "b": self.board.switch_pressed(SWITCH_B),
+            },
+        }
+
+    def status_json(self):
+        """Return the status as JSON text (see status_json.StatusEncoder)."""
+        return str(self.encoder.encode(), "utf-8")
+
+    # ------------------------------------------------------------------
+    # Text protocol
+
+    def execute(self, line):
+        """
+        Execute one protocol command.
+
+        Args:
+            line: Command line without the newline, e.g. "RELAY 1 ON"
+
+        Returns:
+            Response text: "OK", "OK <value>", "ERR <message>" or JSON for
+            STATUS. None for empty and comment lines, which get no response.
+        """
+        line = line.strip()
+        if not line or line.startswith("#"):
+            return None
+
+        parts = line.upper().split()
+        cmd = parts[0]
+        args = parts[1:]
+
+        try:
+            if cmd == "RELAY":
+                return self._cmd_relay(args)
+            if cmd == "OUTPUT":
+                return self._cmd_output(args)
+            if cmd == "INPUT":
+                if not args:
+                    raise CommandError("INPUT requires index")
+                return "OK HIGH" if self.read_input(int(args[0].rstrip("?")) - 1) else "OK LOW"
+            if cmd == "ADC":
+                if not args:
+                    raise CommandError("ADC requires index")
+                return f"OK {self.read_adc(int(args[0].rstrip('?')) - 1):.3f}"
+            if cmd == "LED":
+                return self._cmd_led(args)
+            if cmd == "BUTTON":
+                if not args:
+                    raise CommandError("BUTTON requires button (A/B)")
+                button = self._switch(args[0].rstrip("?"), "BUTTON must be A or B")
+                return "OK PRESSED" if self.board.switch_pressed(button) else "OK RELEASED"
+            if cmd == "STATUS":
+                return self.status_json()
+            if cmd == "RESET":
+                self.reset()
+                return "OK"
+            if cmd == "VERSION":
+                return f"OK {self.version}"
+            if cmd == "HELP":
+                return self.help_text()
+            if cmd == "PING":
+                return "OK PONG"
+            return f"ERR Unknown command: {cmd}"
+        except CommandError as e:
+            return f"ERR {e}"
+        except Exception as e:
+            return f"ERR {type(e).__name__}: {e}"
+
+    def _cmd_relay(self, args):
+        if not args:
+            raise CommandError("RELAY requires arguments")
+        index = int(args[0].rstrip("?")) - 1
+        if args[0].endswith("?"):
+            return "OK ON" if self.relay(index) else "OK OFF"
+        if len(args) < 2:
+            raise CommandError("RELAY requires index and state (ON/OFF)")
+        duration_ms = int(args[2]) if len(args) > 2 else 0
+        self.set_relay(index, parse_state(args[1]), duration_ms)
+        return "OK"
+
+    def _cmd_output(self, args):
+        if not args:
+            raise CommandError("OUTPUT requires arguments")
+        index = int(args[0].rstrip("?")) - 1
+        if args[0].endswith("?"):
+            return f"OK {int(self.output(index) * 100)}"
+        if len(args) < 2:
+            raise CommandError("OUTPUT requires index and value (0-100 or ON/OFF)")
+        duration_ms = int(args[2]) if len(args) > 2 else 0
+        self.set_output(index, parse_output(args[1]), duration_ms)
+        return "OK"
+
+    def _cmd_led(self, args):
+        if not args:
+            raise CommandError("LED requires button (A/B) and brightness")
+        button = self._switch(args[0], "LED button must be A or B")
+        if len(args) < 2:
+            raise CommandError("LED requires brightness (0-100)")
+        self.board.switch_led(button, max(0, min(100, int(args[1]))))
+        return "OK"
+
+    @staticmethod
+    def _switch(name, error):
+        if name == "A":
+            return SWITCH_A
+        if name == "B":
+            return SWITCH_B
+        raise CommandError(error)
+
+    def help_text(self):
+        return f"""OK Commands:
+RELAY <n> <ON|OFF> [ms]   - Set relay (1-{self.num_relays}), optionally for ms
+RELAY <n>?                - Query relay state
+OUTPUT <n> <0-100> [ms]   - Set output PWM % (1-{self.num_outputs}), optionally for ms
+OUTPUT <n> <ON|OFF> [ms]  - Set output full on/off
+OUTPUT <n>?               - Query output state
+INPUT <n>?                - Query input (1-{self.num_inputs})
+ADC <n>?                  - Query ADC voltage (1-{self.num_adcs})
+LED <A|B> <0-100>         - Set button LED brightness
+BUTTON <A|B>?             - Query button state
+STATUS                    - Get all states as JSON
+RESET                     - Reset to safe state
+VERSION                   - Show firmware version
+PING                      - Test connection"""
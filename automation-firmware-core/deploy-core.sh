@@ -0,0 +1,26 @@
+#!/bin/bash
+#
+# Copy the shared firmware core to a connected Automation 2040 W.
+# Compiles it to .mpy first when mpy-cross is installed (smaller, faster to
+# import, no RAM spent on compiling). Called by both firmware flash scripts.
+#
+
+set -e
+
+CORE_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+MODULES="automation_core status_json"
+
+for module in $MODULES; do
+    if command -v mpy-cross &> /dev/null; then
+        echo "   $module.mpy"
+        mkdir -p "$CORE_DIR/build"
+        mpy-cross -o "$CORE_DIR/build/$module.mpy" "$CORE_DIR/$module.py"
+        mpremote cp "$CORE_DIR/build/$module.mpy" ":$module.mpy"
+        # A leftover .py would shadow the .mpy
+        mpremote rm ":$module.py" 2>/dev/null || true
+    else
+        echo "   $module.py (install mpy-cross to deploy as .mpy)"
+        mpremote cp "$CORE_DIR/$module.py" ":$module.py"
+        mpremote rm ":$module.mpy" 2>/dev/null || true
+    fi
+done
@@ -0,0 +1,190 @@
+"""
+Allocation-Free Status JSON Encoder
+===================================
+
+Writes the status object (same keys as AutomationCore.status()) into a
+preallocated bytearray and returns a memoryview of it. Building the
+status through dicts, lists, round() and json.dumps() allocates on
+every call; this encoder allocates nothing per call, so periodic
+publishes do not fragment the heap or trigger garbage collection.
+
+How allocations are avoided:
+- Literal fragments are bytes constants, copied byte by byte
+- Numbers are formatted from integers: output per mille from the core,
+  ADC millivolts from the raw 16-bit reading (no float is ever boxed)
+- Extra members (e.g. the WiFi firmware's "ip") are passed in as
+  pre-encoded bytes that the caller rebuilds only when they change
+- The memoryview slice of the last result is reused while the length
+  stays the same, as it does between periodic publishes with a fixed
+  extra; callers with a varying extra (the HTTP /api/status) get a new
+  slice, but they allocate for the extra anyway
+
+bench/status_json_bench.py checks this under micropython.heap_lock() on
+the unix port.
+"""
+
+from automation import SWITCH_A, SWITCH_B
+
+try:
+    from machine import ADC
+except ImportError:
+    ADC = None
+
+# ADC inputs and divider calibration of the Automation 2040 W, as in the
+# Pimoroni automation library (read_adc() = (raw * 3.3 / 65535 + offset) / gain)
+ADC_PINS = (26, 27, 28)
+try:
+    from automation import VOLTAGE_GAIN, VOLTAGE_OFFSET
+except ImportError:
+    VOLTAGE_GAIN = 0.28058608
+    VOLTAGE_OFFSET = -0.06
+
+_RELAYS = b'{"relays":['
+_OUTPUTS = b'],"outputs":['
+_INPUTS = b'],"inputs":['
+_ADCS = b'],"adcs":['
+_BUTTON_A = b'],"buttons":{"a":'
+_BUTTON_B = b',"b":'
+_TRUE = b"true"
+_FALSE = b"false"
+
+
+def default_adcs(count):
+    """Raw ADC channels for the board, or None off-target (falls back to read_adc())."""
+    if ADC is None:
+        return None
+    try:
+        return [ADC(pin) for pin in ADC_PINS[:count]]
+    except Exception:
+        return None
+
+
+class StatusEncoder:
+    """Encodes AutomationCore status into a reusable buffer."""
+
+    def __init__(self, core, adcs=None, size=512):
+        """
+        Args:
+            core: AutomationCore to encode
+            adcs: Objects with read_u16() per ADC channel (default: machine.ADC)
+            size: Initial buffer size; grows once if an extra does not fit
+        """
+        self.core = core
+        self.adcs = adcs if adcs is not None else default_adcs(core.num_adcs)
+        self._alloc(size)
+
+        # millivolts = (raw * 3300 // 65535 + offset_mv) * scale // 10000,
+        # small enough to stay in small ints
+        self.adc_offset_mv = int(VOLTAGE_OFFSET * 1000)
+        self.adc_scale = int(10000 / VOLTAGE_GAIN + 0.5)
+
+    def _alloc(self, size):
+        self.buf = bytearray(size)
+        self.view = memoryview(self.buf)
+        self.last = self.view[:0]  # Previous result, reused at the same length
+
+    def adc_millivolts(self, index):
+        if self.adcs is None:
+            return int(self.core.read_adc(index) * 1000 + 0.5)  # Allocates (float)
+        mv = (self.adcs[index].read_u16() * 3300 // 65535 + self.adc_offset_mv)
+        mv = mv * self.adc_scale // 10000
+        return mv if mv > 0 else 0
+
+    def encode(self, extra=None):
+        """
+        Encode the status.
+
+        Args:
+            extra: Pre-encoded members appended inside the object, starting
+                   with a comma, e.g. b',"ip":"192.168.1.50"'
+
+        Returns:
+            memoryview of the JSON text, valid until the next call
+        """
+        core = self.core
+        board = core.board
+
+        if extra is not None and len(extra) + 256 > len(self.buf):
+            self._alloc(len(extra) + 256)
+        buf = self.buf
+
+        pos = self._put(0, _RELAYS)
+        for i in range(core.num_relays):
+            if i:
+                buf[pos] = 44  # ,
+                pos += 1
+            pos = self._put(pos, _TRUE if core.relay(i) else _FALSE)
+
+        pos = self._put(pos, _OUTPUTS)
+        for i in range(core.num_outputs):
+            if i:
+                buf[pos] = 44
+                pos += 1
+            pos = self._fixed(pos, core.output_permille[i], 10)  # Percent, 1 decimal
+
+        pos = self._put(pos, _INPUTS)
+        for i in range(core.num_inputs):
+            if i:
+                buf[pos] = 44
+                pos += 1
+            pos = self._put(pos, _TRUE if board.read_input(i) else _FALSE)
+
+        pos = self._put(pos, _ADCS)
+        for i in range(core.num_adcs):
+            if i:
+                buf[pos] = 44
+                pos += 1
+            pos = self._fixed(pos, self.adc_millivolts(i), 1000)  # Volts, 3 decimals
+
+        pos = self._put(pos, _BUTTON_A)
+        pos = self._put(pos, _TRUE if board.switch_pressed(SWITCH_A) else _FALSE)
+        pos = self._put(pos, _BUTTON_B)
+        pos = self._put(pos, _TRUE if board.switch_pressed(SWITCH_B) else _FALSE)
+        buf[pos] = 125  # }
+        pos += 1
+
+        if extra is not None:
+            pos = self._put(pos, extra)
+        buf[pos] = 125
+        pos += 1
+
+        if len(self.last) != pos:
+            self.last = self.view[:pos]
+        return self.last
+
+    def _put(self, pos, data):
+        buf = self.buf
+        for b in data:
+            buf[pos] = b
+            pos += 1
+        return pos
+
+    def _uint(self, pos, n):
+        buf = self.buf
+        start = pos
+        while True:
+            buf[pos] = 48 + n % 10
+            pos += 1
+            n //= 10
+            if not n:
+                break
+        end = pos - 1
+        while start < end:  # Digits were written least significant first
+            buf[start], buf[end] = buf[end], buf[start]
+            start += 1
+            end -= 1
+        return pos
+
+    def _fixed(self, pos, value, scale):
+        """Write value / scale with log10(scale) decimals (value >= 0)."""
+        pos = self._uint(pos, value // scale)
+        buf = self.buf
+        buf[pos] = 46  # .
+        pos += 1
+        frac = value % scale
+        scale //= 10
+        while scale:
+            buf[pos] = 48 + frac // scale % 10
+            pos += 1
+            scale //= 10
+        return pos
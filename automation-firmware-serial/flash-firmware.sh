@@ -80,6 +80,7 @@ echo "Uploading firmware to board..."
 echo
 
 mpremote cp "$TEMP_MAIN" :main.py
+"$SCRIPT_DIR/../automation-firmware-core/deploy-core.sh"
 
 echo
 echo "✓ Firmware uploaded successfully"
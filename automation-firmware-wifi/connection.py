@@ -0,0 +1,213 @@
+"""
+Non-blocking WiFi and MQTT connection state machines
+====================================================
+
+Both links are advanced by calling poll() from the main loop. No call
+waits for the network, so HTTP, input and output handling keep running
+while WiFi or the broker is unreachable. Failed attempts are retried with
+exponential backoff, and the time spent disconnected is tracked per link.
+"""
+
+import time
+
+# Link states
+DOWN = 0        # Waiting for the backoff delay to expire
+CONNECTING = 1  # Attempt in progress
+UP = 2          # Connected
+
+STATE_NAMES = ("down", "connecting", "up")
+
+
+class Link:
+    """Common backoff and outage bookkeeping."""
+
+    def __init__(self, name, led=None, backoff_min_ms=1000, backoff_max_ms=60000):
+        self.name = name
+        self.led = led
+        self.state = DOWN
+        self.backoff_min_ms = backoff_min_ms
+        self.backoff_max_ms = backoff_max_ms
+        self.backoff_ms = 0  # First attempt starts immediately
+        self.state_since = time.ticks_ms()
+
+        # Outage tracking (an outage starts when the link drops, not at boot)
+        self.outages = 0
+        self.last_outage_ms = 0
+        self.total_outage_ms = 0
+        self._outage_start = None
+
+    @property
+    def connected(self):
+        return self.state == UP
+
+    def show_led(self):
+        """Set the indicator LED for the current state (full, half or off)."""
+        if self.led:
+            self.led(100 if self.state == UP else 50 if self.state == CONNECTING else 0)
+
+    def _set_state(self, state, now):
+        self.state = state
+        self.state_since = now
+        self.show_led()
+
+    def _up(self, now):
+        if self._outage_start is not None:
+            self.last_outage_ms = time.ticks_diff(now, self._outage_start)
+            self.total_outage_ms += self.last_outage_ms
+            self._outage_start = None
+            print(f"{self.name}: back up after {self.last_outage_ms} ms")
+        self.backoff_ms = 0
+        self._set_state(UP, now)
+
+    def _down(self, now, retry_now=False):
+        if self.state == UP:
+            self.outages += 1
+            self._outage_start = now
+        if retry_now:
+            self.backoff_ms = 0
+        else:
+            self.backoff_ms = min(
+                self.backoff_max_ms, max(self.backoff_min_ms, self.backoff_ms * 2)
+            )
+        self._set_state(DOWN, now)
+
+    def _retry_due(self, now):
+        return time.ticks_diff(now, self.state_since) >= self.backoff_ms
+
+    def outage_ms(self, now):
+        """Duration of the current outage, or 0 if the link is up."""
+        if self._outage_start is None:
+            return 0
+        return time.ticks_diff(now, self._outage_start)
+
+    def stats(self, now):
+        return {
+            "state": STATE_NAMES[self.state],
+            "outages": self.outages,
+            "outage_ms": self.outage_ms(now),
+            "last_outage_ms": self.last_outage_ms,
+            "total_outage_ms": self.total_outage_ms + self.outage_ms(now),
+        }
+
+
+class WifiLink(Link):
+    """Keeps the station interface associated, reconnecting after drops."""
+
+    def __init__(self, wlan, get_credentials, led=None, timeout_ms=20000, on_up=None, **kwargs):
+        """
+        Args:
+            wlan: network.WLAN(network.STA_IF) instance
+            get_credentials: Callable returning (ssid, password); read on
+                every attempt so config changes take effect on reconnect
+            led: Optional callable taking a brightness 0-100
+            timeout_ms: Give up on an attempt after this long
+            on_up: Optional callable run once each time the link comes up
+        """
+        super().__init__("WiFi", led, **kwargs)
+        self.wlan = wlan
+        self.get_credentials = get_credentials
+        self.timeout_ms = timeout_ms
+        self.on_up = on_up
+
+    def poll(self, now):
+        if self.state == UP:
+            if not self.wlan.isconnected():
+                print("WiFi connection lost")
+                self._down(now, retry_now=True)
+        elif self.state == CONNECTING:
+            if self.wlan.isconnected():
+                print(f"WiFi connected! IP: {self.wlan.ifconfig()[0]}")
+                self._up(now)
+                if self.on_up:
+                    self.on_up()
+            elif self.wlan.status() < 0 or time.ticks_diff(now, self.state_since) >= self.timeout_ms:
+                print(f"WiFi connection failed (status {self.wlan.status()})")
+                self.wlan.disconnect()
+                self._down(now)
+            elif self.led:
+                # Blink while connecting
+                self.led(50 if time.ticks_diff(now, self.state_since) // 500 % 2 == 0 else 0)
+        elif self._retry_due(now):
+            ssid, password = self.get_credentials()
+            print(f"Connecting to WiFi: {ssid}")
+            self._set_state(CONNECTING, now)
+            self.wlan.active(True)
+            self.wlan.connect(ssid, password)
+
+    def reset(self):
+        """Drop the association and reconnect with the current credentials."""
+        self.wlan.disconnect()
+        self._down(time.ticks_ms(), retry_now=True)
+
+
+class MqttLink(Link):
+    """Connects an MQTTClient without blocking on TCP or CONNACK."""
+
+    def __init__(self, make_client, on_connect, led=None, timeout_ms=10000, enabled=True, **kwargs):
+        """
+        Args:
+            make_client: Callable returning a new, unconnected MQTTClient.
+                The client is kept across reconnects, so messages still in
+                flight are resent, and replaced only by reset()
+            on_connect: Called with the client and the CONNACK
+                session-present flag once connected, to send subscriptions
+            led: Optional callable taking a brightness 0-100
+            timeout_ms: Give up on an attempt after this long
+            enabled: False if no MQTT library is available
+        """
+        super().__init__("MQTT", led, backoff_min_ms=2000, **kwargs)
+        self.make_client = make_client
+        self.on_connect = on_connect
+        self.timeout_ms = timeout_ms
+        self.enabled = enabled
+        self.client = None
+
+    def poll(self, now, network_up):
+        if not self.enabled:
+            return
+        if not network_up:
+            if self.state != DOWN:
+                self.drop("network down", retry_now=True)
+            return
+        if self.state == CONNECTING:
+            try:
+                session_present = self.client.poll_connect()
+                if session_present is not None:
+                    self.on_connect(self.client, session_present)
+                    print("MQTT connected!")
+                    self._up(now)
+                elif time.ticks_diff(now, self.state_since) >= self.timeout_ms:
+                    self.drop("timeout")
+            except Exception as e:
+                self.drop(e)
+        elif self.state == DOWN and self._retry_due(now):
+            self._set_state(CONNECTING, now)
+            try:
+                if self.client is None:
+                    self.client = self.make_client()
+                print(f"Connecting to MQTT: {self.client.server}:{self.client.port}")
+                self.client.begin_connect()
+            except Exception as e:
+                self.drop(e)
+
+    def drop(self, reason=None, retry_now=False):
+        """Close the connection after an error; poll() reconnects later."""
+        if self.state != DOWN:
+            if reason is not None:
+                print(f"MQTT connection failed: {reason}")
+            try:
+                self.client.sock.close()
+            except Exception:
+                pass
+            self._down(time.ticks_ms(), retry_now)
+
+    def reset(self):
+        """Reconnect immediately, e.g. after the broker settings changed."""
+        if self.connected:
+            try:
+                self.client.disconnect()
+            except Exception:
+                pass
+        self.drop(retry_now=True)
+        self.client = None  # Built again from the current config
+        self.backoff_ms = 0
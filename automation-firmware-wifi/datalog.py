@@ -0,0 +1,383 @@
+"""
+Flash Data Logger for Automation 2040 W
+=======================================
+
+Keeps a circular history of status samples and input edges in flash so
+that nothing is lost while the network is down.
+
+Records have a fixed size and are collected in a RAM page buffer, which
+is appended to flash in one write when it fills (or after flush_ms). The
+log is split over several segment files used round-robin: when the
+current segment is full the oldest one is truncated and reused. This
+bounds the log size and moves the writes across the filesystem instead
+of rewriting the same blocks.
+
+Record layout (little-endian, 32 bytes):
+
+    offset  size  field
+    0       1     magic 0xA2
+    1       1     kind: 1 = status sample, 2 = input edge
+    2       1     relay bitmask (bit0 = relay 1)
+    3       1     input bitmask (bit0 = input 1)
+    4       4     sequence number (continues across reboots)
+    8       4     time.time() seconds (NTP synced when WiFi connects)
+    12      4     outputs, percent 0-100
+    16      8     ADCs, unsigned 16-bit millivolts
+    24      1     edge: input channel (0-based), 0xFF for samples
+    25      1     edge: level
+    26      2     edge: count (wraps)
+    28      2     reserved
+    30      2     checksum: sum of bytes 0-29
+"""
+
+import os
+import struct
+import time
+
+RECORD = "<BBBBII4B4HBBHHH"
+RECORD_SIZE = 32
+PAGE_SIZE = 256  # Flash program page, 8 records
+MAGIC = 0xA2
+DEFERRED_MAX = 16  # Edges held back while a write is in progress
+
+KIND_SAMPLE = 1
+KIND_EDGE = 2
+KIND_NAMES = {KIND_SAMPLE: "sample", KIND_EDGE: "edge"}
+
+
+def _checksum(buf, offset=0):
+    total = 0
+    for i in range(offset, offset + RECORD_SIZE - 2):
+        total += buf[i]
+    return total & 0xFFFF
+
+
+def valid(buf, offset=0):
+    """True if buf holds an intact record at offset."""
+    return (
+        buf[offset] == MAGIC
+        and struct.unpack_from("<H", buf, offset + RECORD_SIZE - 2)[0] == _checksum(buf, offset)
+    )
+
+
+class DataLog:
+    """Circular flash log of status samples and input edges."""
+
+    def __init__(self, core, directory="log", segments=8, segment_size=16384,
+                 interval_ms=10000, flush_ms=60000):
+        """
+        Args:
+            core: AutomationCore to sample
+            directory: Directory holding the segment files
+            segments: Number of segment files (at least 2)
+            segment_size: Bytes per segment, rounded down to whole pages
+            interval_ms: Time between status samples (0 logs edges only)
+            flush_ms: Longest time a record stays in RAM before it is written
+        """
+        self.core = core
+        self.directory = directory
+        self.segments = max(2, segments)
+        self.segment_records = max(1, segment_size // PAGE_SIZE) * (PAGE_SIZE // RECORD_SIZE)
+        self.interval_ms = interval_ms
+        self.flush_ms = flush_ms
+
+        self.page = bytearray(PAGE_SIZE)
+        self.page_view = memoryview(self.page)
+        self.page_len = 0
+        self.reading = False  # Set while a download streams the segment files
+        # Input edges are logged from a micropython.schedule() callback, which
+        # can run in the middle of an append or flush from the main loop. They
+        # queue here while busy and are logged when that call completes.
+        self.busy = False
+        self.deferred = []
+
+        # First sequence number and record count of each segment (None = unused)
+        self.first = [None] * self.segments
+        self.count = [0] * self.segments
+        self.current = 0
+        self.next_seq = 0  # Sequence number of the next record
+        self.flushed_seq = 0  # Sequence number of the first record still in RAM
+        self._rotate = False
+
+        self.writes = 0
+        self.errors = 0
+        self.dropped = 0
+        self.last_sample = time.ticks_ms()
+        self.last_flush = self.last_sample
+
+        self._recover()
+        print(f"Data log: {self.records()} records, {self.segments} x "
+              f"{self.segment_records} record segments")
+
+    def _path(self, index):
+        return f"{self.directory}/{index}.bin"
+
+    def _recover(self):
+        """Rebuild the segment index and sequence counter from flash."""
+        try:
+            os.mkdir(self.directory)
+        except OSError:
+            pass  # Already exists
+
+        buf = bytearray(RECORD_SIZE)
+        newest = None
+        for i in range(self.segments):
+            try:
+                size = os.stat(self._path(i))[6]
+            except OSError:
+                continue
+            n = min(size // RECORD_SIZE, self.segment_records)
+            if not n:
+                continue
+            with open(self._path(i), "rb") as f:
+                f.readinto(buf)
+                if not valid(buf):
+                    continue  # Corrupt, reused when its turn comes
+                first = struct.unpack_from("<I", buf, 4)[0]
+                # Keep the intact prefix of a segment torn by a power cut
+                last = n - 1
+                while last:
+                    f.seek(last * RECORD_SIZE)
+                    f.readinto(buf)
+                    if valid(buf) and struct.unpack_from("<I", buf, 4)[0] == first + last:
+                        break
+                    last -= 1
+            self.first[i] = first
+            self.count[i] = last + 1
+            if newest is None or first > self.first[newest]:
+                newest = i
+                # Appending after a torn or partly written tail would misalign records
+                self._rotate = size != self.count[i] * RECORD_SIZE
+
+        if newest is not None:
+            self.current = newest
+            self.next_seq = self.first[newest] + self.count[newest]
+            self.flushed_seq = self.next_seq
+
+    # ------------------------------------------------------------------
+    # Writing
+
+    def poll(self, now):
+        """Take a status sample and flush the page buffer when due."""
+        if self.interval_ms and time.ticks_diff(now, self.last_sample) >= self.interval_ms:
+            self.last_sample = now
+            self.log_sample()
+        if self.page_len and time.ticks_diff(now, self.last_flush) >= self.flush_ms:
+            self.flush()
+
+    def log_sample(self):
+        self.busy = True
+        try:
+            self._append(KIND_SAMPLE)
+        finally:
+            self._done()
+
+    def log_edge(self, channel, level, count):
+        if len(self.deferred) >= DEFERRED_MAX:
+            self.dropped += 1
+            return
+        self.deferred.append((channel, 1 if level else 0, count & 0xFFFF))
+        if not self.busy:
+            self.busy = True
+            self._done()
+
+    def _done(self):
+        """Log the deferred edges in order, then clear the busy flag."""
+        deferred = self.deferred
+        while True:
+            try:
+                while deferred:
+                    channel, level, count = deferred.pop(0)
+                    self._append(KIND_EDGE, channel, level, count)
+            finally:
+                self.busy = False
+            # An edge scheduled just before the flag cleared is still queued
+            if not deferred:
+                return
+            self.busy = True
+
+    def _append(self, kind, channel=0xFF, level=0, count=0):
+        if self.page_len + RECORD_SIZE > PAGE_SIZE:
+            self._flush()
+            if self.page_len + RECORD_SIZE > PAGE_SIZE:
+                self.dropped += 1  # Flush deferred by a download in progress
+                return
+
+        core = self.core
+        relays = 0
+        for i in range(core.num_relays):
+            if core.relay(i):
+                relays |= 1 << i
+        inputs = 0
+        for i in range(core.num_inputs):
+            if core.read_input(i):
+                inputs |= 1 << i
+        outputs = [0, 0, 0, 0]
+        for i in range(min(4, core.num_outputs)):
+            outputs[i] = int(core.output(i) * 100 + 0.5)
+        adcs = [0, 0, 0, 0]
+        for i in range(min(4, core.num_adcs)):
+            adcs[i] = max(0, min(0xFFFF, int(core.read_adc(i) * 1000 + 0.5)))
+
+        offset = self.page_len
+        struct.pack_into(
+            RECORD, self.page, offset,
+            MAGIC, kind, relays, inputs, self.next_seq, int(time.time()),
+            outputs[0], outputs[1], outputs[2], outputs[3],
+            adcs[0], adcs[1], adcs[2], adcs[3],
+            channel, level, count, 0, 0,
+        )
+        struct.pack_into("<H", self.page, offset + RECORD_SIZE - 2, _checksum(self.page, offset))
+        self.page_len += RECORD_SIZE
+        self.next_seq += 1
+
+    def flush(self):
+        """Append the buffered records to flash."""
+        self.busy = True
+        try:
+            self._flush()
+        finally:
+            self._done()
+
+    def _flush(self):
+        if not self.page_len or self.reading:
+            return
+        n = self.page_len // RECORD_SIZE
+        done = 0
+        try:
+            while done < n:
+                if self._rotate or self.count[self.current] >= self.segment_records:
+                    self._next_segment()
+                take = min(n - done, self.segment_records - self.count[self.current])
+                with open(self._path(self.current), "ab") as f:
+                    f.write(self.page_view[done * RECORD_SIZE:(done + take) * RECORD_SIZE])
+                if self.first[self.current] is None:
+                    self.first[self.current] = self.flushed_seq
+                self.count[self.current] += take
+                self.flushed_seq += take
+                done += take
+            self.writes += 1
+        except OSError as e:
+            # Filesystem full or failing: drop the page rather than grow RAM
+            self.errors += 1
+            self.dropped += n - done
+            self.flushed_seq += n - done
+            self._rotate = True
+            print(f"Data log write failed: {e}")
+        self.page_len = 0
+        self.last_flush = time.ticks_ms()
+
+    def _next_segment(self):
+        """Truncate the oldest segment and make it current."""
+        self.current = (self.current + 1) % self.segments
+        self.first[self.current] = None
+        self.count[self.current] = 0
+        self._rotate = False
+        open(self._path(self.current), "wb").close()
+
+    # ------------------------------------------------------------------
+    # Reading
+
+    def _order(self):
+        """Used segment indices, oldest first."""
+        order = []
+        for k in range(1, self.segments + 1):
+            i = (self.current + k) % self.segments
+            if self.first[i] is not None:
+                order.append(i)
+        return order
+
+    def records(self):
+        """Number of records in the log, including the RAM buffer."""
+        return sum(self.count) + self.page_len // RECORD_SIZE
+
+    def first_seq(self):
+        """Sequence number of the oldest record still in the log."""
+        order = self._order()
+        return self.first[order[0]] if order else self.flushed_seq
+
+    def size(self):
+        """Bytes of flushed log data, as served by stream()."""
+        return sum(self.count) * RECORD_SIZE
+
+    def read_record(self, seq, buf):
+        """
+        Copy record `seq` into buf (RECORD_SIZE bytes).
+
+        Returns:
+            False if the record was overwritten, lost or not written yet.
+        """
+        if seq >= self.flushed_seq:
+            offset = (seq - self.flushed_seq) * RECORD_SIZE
+            if offset >= self.page_len:
+                return False
+            buf[:] = self.page_view[offset:offset + RECORD_SIZE]
+            return True
+        for i in self._order():
+            first = self.first[i]
+            if first <= seq < first + self.count[i]:
+                with open(self._path(i), "rb") as f:
+                    f.seek((seq - first) * RECORD_SIZE)
+                    return f.readinto(buf) == RECORD_SIZE and valid(buf)
+        return False
+
+    def stream(self, start, end, buf):
+        """
+        Yield the flushed log bytes [start, end) oldest first, in pieces of
+        at most len(buf) bytes. The pieces are views into buf.
+        """
+        view = memoryview(buf)
+        pos = 0
+        self.reading = True
+        try:
+            for i in self._order():
+                size = self.count[i] * RECORD_SIZE
+                if pos + size <= start:
+                    pos += size
+                    continue
+                if pos >= end:
+                    break
+                skip = max(0, start - pos)
+                remaining = min(size, end - pos) - skip
+                with open(self._path(i), "rb") as f:
+                    f.seek(skip)
+                    while remaining > 0:
+                        n = f.readinto(view[:min(len(buf), remaining)])
+                        if not n:
+                            break
+                        remaining -= n
+                        yield view[:n]
+                pos += size
+        finally:
+            self.reading = False
+
+    def decode(self, buf):
+        """Decode one record into a dict (lists trimmed to the board's channels)."""
+        f = struct.unpack(RECORD, buf)
+        core = self.core
+        record = {
+            "seq": f[4],
+            "time": f[5],
+            "kind": KIND_NAMES.get(f[1], f[1]),
+            "relays": [bool(f[2] >> i & 1) for i in range(core.num_relays)],
+            "inputs": [bool(f[3] >> i & 1) for i in range(core.num_inputs)],
+            "outputs": list(f[6:6 + min(4, core.num_outputs)]),
+            "adcs": [mv / 1000 for mv in f[10:10 + min(4, core.num_adcs)]],
+        }
+        if f[1] == KIND_EDGE:
+            record["input"] = f[14] + 1
+            record["state"] = "HIGH" if f[15] else "LOW"
+            record["count"] = f[16]
+        return record
+
+    def stats(self):
+        return {
+            "records": self.records(),
+            "first_seq": self.first_seq(),
+            "next_seq": self.next_seq,
+            "bytes": self.size(),
+            "capacity": self.segments * self.segment_records,
+            "writes": self.writes,
+            "errors": self.errors,
+            "dropped": self.dropped,
+        }
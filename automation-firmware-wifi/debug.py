@@ -0,0 +1,112 @@
+"""
+Runtime Introspection for Automation 2040 W
+===========================================
+
+Counters behind GET /api/debug: main loop period histogram, per-route
+HTTP handler time and MQTT publish time.
+
+Recording is one time.ticks_us() call and a few integer updates into
+preallocated storage, so it stays enabled in production. The expensive
+part (probing the largest free heap block) only runs when /api/debug is
+requested.
+"""
+
+import gc
+import time
+from array import array
+
+# Upper bounds (ms) of the main loop period histogram buckets; the last
+# bucket is open-ended. The loop sleeps 10 ms, so < 12 ms is "idle".
+LOOP_BUCKETS_MS = (12, 15, 20, 50, 100, 250, 1000)
+
+
+class Profiler:
+    """Loop period histogram and named duration timers."""
+
+    def __init__(self):
+        self.loop_hist = array("I", [0] * (len(LOOP_BUCKETS_MS) + 1))
+        self.loop_max_us = 0
+        self.loops = 0
+        self.last_loop = time.ticks_us()
+        self.started = time.ticks_ms()
+        self.timers = {}  # name -> [count, total_us, max_us]
+
+    def loop(self):
+        """Record one main loop pass. Call once per iteration."""
+        now = time.ticks_us()
+        period = time.ticks_diff(now, self.last_loop)
+        self.last_loop = now
+        ms = period // 1000
+        i = 0
+        for bound in LOOP_BUCKETS_MS:
+            if ms < bound:
+                break
+            i += 1
+        self.loop_hist[i] += 1
+        if period > self.loop_max_us:
+            self.loop_max_us = period
+        self.loops += 1
+
+    def record(self, name, start_us):
+        """Add the time since start_us (a time.ticks_us() value) to timer `name`."""
+        elapsed = time.ticks_diff(time.ticks_us(), start_us)
+        t = self.timers.get(name)
+        if t is None:
+            t = self.timers[name] = [0, 0, 0]
+        t[0] += 1
+        t[1] += elapsed
+        if elapsed > t[2]:
+            t[2] = elapsed
+
+    def stats(self):
+        labels = []
+        low = 0
+        for bound in LOOP_BUCKETS_MS:
+            labels.append(f"{low}-{bound}ms")
+            low = bound
+        labels.append(f">={low}ms")
+
+        timers = {}
+        for name, (count, total, peak) in self.timers.items():
+            timers[name] = {"count": count, "avg_us": total // count, "max_us": peak}
+
+        return {
+            "uptime_ms": time.ticks_diff(time.ticks_ms(), self.started),
+            "loop": {
+                "count": self.loops,
+                "max_us": self.loop_max_us,
+                "histogram": dict(zip(labels, self.loop_hist)),
+            },
+            "timers": timers,
+        }
+
+
+def largest_free_block(limit):
+    """
+    Size of the largest allocatable block, found by binary search.
+
+    Allocates and frees test buffers with a gc.collect() each, so this
+    takes tens of milliseconds. Only call it on request.
+    """
+    lo, hi = 0, limit
+    while hi - lo > 16:
+        mid = (lo + hi) // 2
+        try:
+            probe = bytearray(mid)
+            del probe
+            lo = mid
+        except MemoryError:
+            hi = mid
+        gc.collect()
+    return lo
+
+
+def memory():
+    """Heap usage, including fragmentation."""
+    gc.collect()
+    free = gc.mem_free()
+    return {
+        "free": free,
+        "alloc": gc.mem_alloc(),
+        "largest_free_block": largest_free_block(free),
+    }
@@ -48,6 +48,38 @@ mpremote cp config.py :config.py
 
 echo "   http_server.py"
 mpremote cp http_server.py :http_server.py
+mpremote cp http_request.py :http_request.py
+mpremote cp http_response.py :http_response.py
+
+echo "   automation_core (shared firmware core)"
+"$SCRIPT_DIR/../automation-firmware-core/deploy-core.sh"
+
+echo "   inputs.py"
+mpremote cp inputs.py :inputs.py
+
+echo "   connection.py"
+mpremote cp connection.py :connection.py
+
+echo "   tcp_server.py"
+mpremote cp tcp_server.py :tcp_server.py
+
+echo "   telemetry.py"
+mpremote cp telemetry.py :telemetry.py
+
+echo "   offline.py"
+mpremote cp offline.py :offline.py
+
+echo "   datalog.py"
+mpremote cp datalog.py :datalog.py
+
+echo "   debug.py"
+mpremote cp debug.py :debug.py
+
+echo "   ota.py"
+mpremote cp ota.py :ota.py
+
+echo "   power.py"
+mpremote cp power.py :power.py
 
 echo
 echo "🔄 Resetting device..."
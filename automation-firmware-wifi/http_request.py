@@ -0,0 +1,210 @@
+"""
+Incremental HTTP Request Parser for Automation 2040 W
+=====================================================
+
+Reads a request from a client socket into reusable buffers and parses
+it as the bytes arrive, instead of assuming the whole request fits in a
+single recv():
+
+- The request line and headers are scanned line by line as segments
+  arrive. Only the headers the server uses are decoded to strings.
+- The body is read up to Content-Length, across as many TCP segments as
+  it takes.
+- Oversized headers (431) and bodies (413) are rejected before they are
+  read. Stalled clients time out (408).
+"""
+
+import select
+import time
+
+# Headers kept in Request.headers (lower case); all others are skipped
+WANTED_HEADERS = (
+    b"content-length", b"content-type", b"range", b"transfer-encoding", b"x-signature",
+)
+
+REASONS = {
+    400: "Bad Request",
+    408: "Request Timeout",
+    413: "Payload Too Large",
+    431: "Request Header Fields Too Large",
+    501: "Not Implemented",
+}
+
+
+class RequestError(Exception):
+    """Malformed or unacceptable request; answered with `status`."""
+
+    def __init__(self, status, message):
+        super().__init__(message)
+        self.status = status
+
+    def response(self):
+        reason = REASONS.get(self.status, "Error")
+        return f"HTTP/1.0 {self.status} {reason}\r\nConnection: close\r\n\r\n{self.args[0]}"
+
+
+class Request:
+    """A parsed request. `body` is a view into the reader's buffer."""
+
+    def __init__(self):
+        self.method = None
+        self.path = None
+        self.query = ""  # After the "?", not part of path
+        self.http11 = False  # Client accepts HTTP/1.1 responses (chunked encoding)
+        self.headers = {}
+        self.body = None
+
+    def text(self):
+        """Body decoded as UTF-8 (empty string if there is none)."""
+        return str(self.body, "utf-8") if self.body else ""
+
+
+def _name_is(buf, start, end, name):
+    """Case-insensitive compare of buf[start:end] with a lower-case name."""
+    if end - start != len(name):
+        return False
+    for i in range(len(name)):
+        if buf[start + i] | 0x20 != name[i]:
+            return False
+    return True
+
+
+def url_decode(text):
+    """Decode an application/x-www-form-urlencoded value."""
+    text = text.replace("+", " ")
+    if "%" not in text:
+        return text
+    out = bytearray()
+    i = 0
+    raw = text.encode()
+    while i < len(raw):
+        if raw[i] == 37 and i + 2 < len(raw):  # %XX
+            try:
+                out.append(int(raw[i + 1:i + 3], 16))
+                i += 3
+                continue
+            except ValueError:
+                pass
+        out.append(raw[i])
+        i += 1
+    return out.decode()
+
+
+def parse_form(body):
+    """Parse a urlencoded form body into a dict."""
+    params = {}
+    for pair in body.split("&"):
+        if "=" in pair:
+            key, value = pair.split("=", 1)
+            params[url_decode(key)] = url_decode(value)
+    return params
+
+
+class RequestReader:
+    """Reads requests into preallocated buffers. One instance per server."""
+
+    def __init__(self, head_size=1024, max_body=2048, timeout_ms=2000):
+        """
+        Args:
+            head_size: Largest request line + headers accepted
+            max_body: Largest body accepted
+            timeout_ms: Time allowed for the complete request
+        """
+        self.head = bytearray(head_size)
+        self.head_view = memoryview(self.head)
+        self.body = bytearray(max_body)
+        self.body_view = memoryview(self.body)
+        self.timeout_ms = timeout_ms
+        self.poller = select.poll()
+
+    def read(self, sock):
+        """
+        Read and parse one request. Leaves the socket non-blocking.
+
+        Raises:
+            RequestError: Malformed, oversized or timed out request
+        """
+        sock.setblocking(False)
+        self.poller.register(sock, select.POLLIN)
+        try:
+            return self._read(sock, time.ticks_add(time.ticks_ms(), self.timeout_ms))
+        finally:
+            self.poller.unregister(sock)
+
+    def _recv(self, sock, view, deadline):
+        """Read whatever is available into view, waiting until deadline."""
+        while True:
+            n = sock.readinto(view)
+            if n:
+                return n
+            if n == 0:
+                raise RequestError(400, "Connection closed mid-request")
+            remaining = time.ticks_diff(deadline, time.ticks_ms())
+            if remaining <= 0 or not self.poller.poll(remaining):
+                raise RequestError(408, "Request timed out")
+
+    def _read(self, sock, deadline):
+        head = self.head
+        request = Request()
+        filled = 0  # Bytes received into head
+        scan = 0  # Next byte to look at
+        line_start = 0
+        head_end = -1
+
+        # Request line and headers, parsed line by line as they arrive
+        while head_end < 0:
+            if filled == len(head):
+                raise RequestError(431, "Request header too large")
+            filled += self._recv(sock, self.head_view[filled:], deadline)
+            while scan < filled:
+                if head[scan] == 10:  # \n
+                    end = scan - 1 if scan > line_start and head[scan - 1] == 13 else scan
+                    if end == line_start:
+                        head_end = scan + 1  # Blank line: end of headers
+                        break
+                    self._line(request, line_start, end)
+                    line_start = scan + 1
+                scan += 1
+
+        if request.method is None:
+            raise RequestError(400, "Missing request line")
+        if "transfer-encoding" in request.headers:
+            raise RequestError(501, "Chunked request bodies are not supported")
+
+        # Body, rejected before reading if it cannot fit
+        try:
+            length = int(request.headers.get("content-length", 0))
+        except ValueError:
+            raise RequestError(400, "Bad Content-Length") from None
+        if length > len(self.body):
+            raise RequestError(413, f"Body too large (max {len(self.body)} bytes)")
+        if length:
+            got = min(filled - head_end, length)
+            self.body_view[:got] = self.head_view[head_end:head_end + got]
+            while got < length:
+                got += self._recv(sock, self.body_view[got:length], deadline)
+            request.body = self.body_view[:length]
+        return request
+
+    def _line(self, request, start, end):
+        head = self.head
+        if request.method is None:
+            # Request line: METHOD SP PATH SP VERSION
+            parts = str(self.head_view[start:end], "utf-8").split(" ")
+            if len(parts) < 2:
+                raise RequestError(400, "Bad request line")
+            request.method = parts[0]
+            request.path, _, request.query = parts[1].partition("?")
+            request.http11 = len(parts) > 2 and parts[2] == "HTTP/1.1"
+            return
+
+        colon = start
+        while colon < end and head[colon] != 58:  # :
+            colon += 1
+        if colon == end:
+            return  # Not a header line, ignore
+        for name in WANTED_HEADERS:
+            if _name_is(head, start, colon, name):
+                value = str(self.head_view[colon + 1:end], "utf-8").strip()
+                request.headers[name.decode()] = value
+                return
@@ -0,0 +1,161 @@
+"""
+Streaming HTTP Response Writer for Automation 2040 W
+====================================================
+
+Sends responses through one preallocated buffer instead of building the
+whole page as a str, encoding it into a second copy and slicing a third
+copy per 512-byte chunk:
+
+- Bodies may be str/bytes/memoryview, a generator of such pieces, or a
+  file object (read with readinto() straight into the buffer)
+- Pieces are copied into the buffer and sent whenever it fills, so peak
+  heap is the buffer plus the largest piece, whatever the response size
+- Bodies of unknown length use chunked transfer encoding for HTTP/1.1
+  clients; HTTP/1.0 clients get the body delimited by connection close
+
+Every buffer send is one TCP write, so headers and small bodies go out
+in a single segment.
+"""
+
+CHUNK_HEAD = 6  # Four hex digits + CRLF, zero padded so it never moves
+CHUNK_TAIL = 2  # CRLF after the chunk data
+HEX = b"0123456789abcdef"
+
+
+def _buffer(data):
+    """Bytes view of data without copying."""
+    try:
+        return memoryview(data)  # MicroPython str supports the buffer protocol
+    except TypeError:
+        return data.encode()  # CPython str (bench harness)
+
+
+class ResponseWriter:
+    """Writes responses through a reusable buffer. One instance per server."""
+
+    def __init__(self, size=512):
+        """
+        Args:
+            size: Bytes per TCP write (and per chunk); at most 0xFFFF
+        """
+        self.size = size
+        self.buf = bytearray(CHUNK_HEAD + size + CHUNK_TAIL)
+        self.view = memoryview(self.buf)
+        self.data = self.view[CHUNK_HEAD:CHUNK_HEAD + size]  # Payload area
+        self.sock = None
+        self.pos = CHUNK_HEAD
+        self.chunked = False
+        self.sent = 0  # Body bytes of the current response
+
+    def send(self, sock, body, content_type="text/html", status="200 OK", http11=True):
+        """
+        Send a complete response and return the body size.
+
+        Args:
+            sock: Connected client socket (blocking or with a timeout)
+            body: str, bytes, memoryview, generator of those, or file object
+            http11: Client spoke HTTP/1.1 (chunked encoding allowed)
+        """
+        if isinstance(body, str):
+            body = _buffer(body)
+        length = len(body) if isinstance(body, (bytes, bytearray, memoryview)) else -1
+
+        self.begin(sock, status, content_type, length, http11)
+        if length >= 0:
+            self.write(body)
+        elif hasattr(body, "readinto"):
+            self.write_file(body)
+        else:
+            for piece in body:
+                self.write(piece)
+        self.end()
+        return self.sent
+
+    def begin(self, sock, status, content_type, length=-1, http11=True, extra=""):
+        """
+        Start a response: buffer the status line and headers.
+
+        Args:
+            length: Body size, or -1 if unknown (chunked for HTTP/1.1)
+            extra: Additional header lines, each ending in CRLF
+        """
+        self.sock = sock
+        self.pos = CHUNK_HEAD
+        self.chunked = False
+        self.sent = 0
+        if length >= 0:
+            framing = f"Content-Length: {length}\r\n"
+        elif http11:
+            framing = "Transfer-Encoding: chunked\r\n"
+        else:
+            framing = ""
+        self.write(f"HTTP/1.1 {status}\r\nContent-Type: {content_type}\r\n{framing}{extra}"
+                   "Connection: close\r\n\r\n")
+        self.sent = 0
+        if length < 0 and http11:
+            self.flush()  # Headers are never chunk-framed
+            self.chunked = True
+
+    def write(self, data):
+        """Append data to the response, sending each time the buffer fills."""
+        if isinstance(data, str):
+            data = _buffer(data)
+        n = len(data)
+        self.sent += n
+        end = CHUNK_HEAD + self.size
+        pos = self.pos
+        if pos + n <= end:
+            self.buf[pos:pos + n] = data
+            self.pos = pos + n
+            return
+
+        data = memoryview(data)
+        off = 0
+        while off < n:
+            if pos == end:
+                self.pos = pos
+                self.flush()
+                pos = CHUNK_HEAD
+            k = min(end - pos, n - off)
+            self.buf[pos:pos + k] = data[off:off + k]
+            pos += k
+            off += k
+        self.pos = pos
+
+    def write_file(self, f):
+        """Append the rest of file f, read straight into the buffer."""
+        end = CHUNK_HEAD + self.size
+        while True:
+            if self.pos == end:
+                self.flush()
+            n = f.readinto(self.view[self.pos:end])
+            if not n:
+                break
+            self.pos += n
+            self.sent += n
+
+    def flush(self):
+        """Send the buffered bytes as one write (one chunk if chunked)."""
+        n = self.pos - CHUNK_HEAD
+        if not n:
+            return
+        if self.chunked:
+            buf = self.buf
+            for i in range(4):
+                buf[i] = HEX[n >> (12 - 4 * i) & 0xF]
+            buf[4] = 13
+            buf[5] = 10
+            buf[CHUNK_HEAD + n] = 13
+            buf[CHUNK_HEAD + n + 1] = 10
+            self.sock.sendall(self.view[:CHUNK_HEAD + n + CHUNK_TAIL])
+        else:
+            self.sock.sendall(self.view[CHUNK_HEAD:CHUNK_HEAD + n])
+        self.pos = CHUNK_HEAD
+
+    def end(self):
+        """Finish the response (sends the last chunk marker if chunked)."""
+        self.flush()
+        if self.chunked:
+            self.sock.sendall(b"0\r\n\r\n")
+            self.chunked = False
+        self.sock = None
@@ -7,9 +7,18 @@ Provides a settings web interface and REST API.
 
 import socket
 import json
+import time
 
-# HTML template for settings page
-SETTINGS_PAGE = """<!DOCTYPE html>
+from http_request import RequestReader, RequestError, parse_form
+from http_response import ResponseWriter
+
+# Request and response buffers, allocated once by start_http_server()
+reader = None
+writer = None
+
+# HTML template for settings page. Streamed in place: the text between
+# the %s markers is sent as memoryview slices, values are sent in between.
+SETTINGS_PAGE = b"""<!DOCTYPE html>
 <html>
 <head>
     <meta charset="UTF-8">
@@ -38,13 +47,14 @@ SETTINGS_PAGE = """<!DOCTYPE html>
         .io-value.on { color: #22c55e; }
         .io-value.off { color: #555; }
         .io-value.volt { color: #a855f7; }
+        .trend { display: block; width: 100%; height: 40px; margin-top: 8px; }
         .field { margin-bottom: 16px; }
         label { display: block; font-size: 14px; color: #71767b; margin-bottom: 6px; }
-        input { width: 100%%; padding: 10px 12px; background: #0f1419; border: 1px solid #2f3336; border-radius: 8px; color: #e7e9ea; font-size: 14px; }
+        input { width: 100%; padding: 10px 12px; background: #0f1419; border: 1px solid #2f3336; border-radius: 8px; color: #e7e9ea; font-size: 14px; }
         input:focus { outline: none; border-color: #f97316; }
         .row { display: flex; gap: 12px; }
         .row .field { flex: 1; }
-        button { width: 100%%; padding: 12px; background: #f97316; color: white; border: none; border-radius: 8px; font-size: 16px; font-weight: 600; cursor: pointer; margin-top: 8px; }
+        button { width: 100%; padding: 12px; background: #f97316; color: white; border: none; border-radius: 8px; font-size: 16px; font-weight: 600; cursor: pointer; margin-top: 8px; }
         button:hover { background: #ea580c; }
         button.secondary { background: transparent; border: 1px solid #2f3336; color: #71767b; }
         .update-indicator { font-size: 11px; color: #71767b; text-align: right; margin-top: 8px; }
@@ -55,8 +65,8 @@ SETTINGS_PAGE = """<!DOCTYPE html>
         <h1>Automation 2040 W</h1>
         <p class="subtitle">Control Panel</p>
         
-        <div class="status %s"><span>WiFi: %s</span></div>
-        <div class="status %s"><span>MQTT: %s</span></div>
+        <div class="status %s" id="wifi-status"><span>WiFi: %s</span></div>
+        <div class="status %s" id="mqtt-status"><span>MQTT: %s</span></div>
         
         <div class="card">
             <h2>I/O Status</h2>
@@ -116,38 +126,198 @@ SETTINGS_PAGE = """<!DOCTYPE html>
     </div>
     
     <script>
+        // One status request in flight at most, each timed from the end of
+        // the last; refresh() calls meanwhile become one follow-up. Failures
+        // double the interval, slow answers stretch it to 4x the response
+        // time (up to 30 s), and hidden tabs do not poll at all.
+        var REFRESH_MS = 1000, REFRESH_MAX_MS = 30000;
+        var refreshDelay = REFRESH_MS, refreshTimer = null;
+        var refreshing = false, refreshAgain = false;
+
+        function refreshDone(ok, elapsed) {
+            refreshing = false;
+            refreshDelay = Math.min(ok ? Math.max(REFRESH_MS, elapsed * 4) : refreshDelay * 2,
+                                    REFRESH_MAX_MS);
+            document.getElementById('countdown').textContent = Math.round(refreshDelay / 1000);
+            if (refreshAgain) {
+                refreshAgain = false;
+                refresh();
+            } else if (!document.hidden) {
+                refreshTimer = setTimeout(refresh, refreshDelay);
+            }
+        }
+
+        document.addEventListener('visibilitychange', function() {
+            clearTimeout(refreshTimer);
+            if (!document.hidden && !refreshing) refresh();
+        });
+
+        function setLink(id, label, ok, text) {
+            var el = document.getElementById(id);
+            el.className = 'status ' + (ok ? 'ok' : 'err');
+            el.firstChild.textContent = label + ': ' + text;
+        }
+
+        // Optimistic controls: a click shows the new state at once; changes
+        // within BATCH_MS go out together as one POST /api/io. Refreshes keep
+        // showing a change until a status requested after it was applied
+        // arrives; a failed batch rolls back to the last status.
+        var BATCH_MS = 150;
+        var pending = {relays: {}, outputs: {}};  // n -> {value, sent, applied}
+        var lastStatus = null, batchTimer = null, batching = false;
+
+        function shown(kind, n, actual) {
+            var change = pending[kind][n];
+            return change ? change.value : actual;
+        }
+
+        function showControl(kind, n, value) {
+            var el = document.getElementById((kind == 'relays' ? 'relay-' : 'output-') + n);
+            if (!el) return;
+            var on = kind == 'relays' ? value : value > 0;
+            el.className = 'io-value ' + (on ? 'on' : 'off');
+            el.textContent = on ? 'ON' : 'OFF';
+        }
+
+        function setControl(kind, n, value) {
+            pending[kind][n] = {value: value, sent: false, applied: null};
+            showControl(kind, n, value);
+            clearTimeout(batchTimer);
+            batchTimer = setTimeout(sendBatch, BATCH_MS);
+        }
+
+        function sendBatch() {
+            if (batching) return;  // Sent when the current batch is done
+            var body = {relays: {}, outputs: {}}, sent = [];
+            ['relays', 'outputs'].forEach(function(kind) {
+                for (var n in pending[kind]) {
+                    var change = pending[kind][n];
+                    if (!change.sent) {
+                        change.sent = true;
+                        body[kind][n] = change.value;
+                        sent.push([kind, n, change]);
+                    }
+                }
+            });
+            if (!sent.length) return;
+
+            batching = true;
+            fetch('/api/io', {method: 'POST', headers: {'Content-Type': 'application/json'},
+                              body: JSON.stringify(body)}).then(function(r) {
+                if (!r.ok) throw new Error('Control batch failed');
+                var now = Date.now();
+                sent.forEach(function(s) { s[2].applied = now; });
+            }).catch(function(err) {
+                console.error(err);
+                sent.forEach(function(s) {
+                    if (pending[s[0]][s[1]] !== s[2]) return;  // Changed again since
+                    delete pending[s[0]][s[1]];
+                    if (lastStatus) showControl(s[0], s[1], lastStatus[s[0]][s[1] - 1]);
+                });
+            }).then(function() {
+                batching = false;
+                sendBatch();
+                refresh();
+            });
+        }
+
+        // Forget changes that a status requested at `started` already shows
+        function settleControls(started) {
+            ['relays', 'outputs'].forEach(function(kind) {
+                for (var n in pending[kind]) {
+                    var applied = pending[kind][n].applied;
+                    if (applied !== null && applied < started) delete pending[kind][n];
+                }
+            });
+        }
+
         function toggleRelay(n) {
-            fetch('/api/relay/' + n + '/toggle', {method: 'POST'})
-                .then(function() { refresh(); });
+            var el = document.getElementById('relay-' + n);
+            if (el) setControl('relays', n, el.className.indexOf(' on') < 0);
         }
         
         function toggleOutput(n) {
-            fetch('/api/output/' + n + '/toggle', {method: 'POST'})
-                .then(function() { refresh(); });
+            var el = document.getElementById('output-' + n);
+            if (el) setControl('outputs', n, el.className.indexOf(' on') < 0 ? 100 : 0);
         }
         
         function resetAll() {
+            pending = {relays: {}, outputs: {}};
             fetch('/api/reset', {method: 'POST'}).then(function() { refresh(); });
         }
         
+        // ADC trend charts: the last TREND_LEN readings per channel in a
+        // Float32Array ring. A reading scrolls the canvas one column left and
+        // draws only the newest segment; the ring is replayed in full only
+        // when the scale has to grow.
+        var TREND_LEN = 120, TREND_COL = 2, TREND_SCALES = [3.3, 12, 24, 40];  // 240 px canvases
+        var trends = [];
+
+        function trendPush(i, volts) {
+            var t = trends[i];
+            if (!t) {
+                t = trends[i] = {data: new Float32Array(TREND_LEN), head: 0, count: 0,
+                                 scale: TREND_SCALES[0], drawn: false};
+            }
+            t.data[t.head] = volts;
+            t.head = (t.head + 1) % TREND_LEN;
+            if (t.count < TREND_LEN) t.count++;
+
+            var canvas = document.getElementById('trend-' + (i+1));
+            if (!canvas) return;
+            var scale = t.scale;
+            for (var s = 0; volts > scale && s < TREND_SCALES.length; s++) {
+                scale = TREND_SCALES[s];
+            }
+            if (!t.drawn || scale != t.scale) {
+                t.drawn = true;
+                t.scale = scale;
+                canvas.getContext('2d').clearRect(0, 0, canvas.width, canvas.height);
+                trendDraw(t, canvas, t.count - 1);
+            } else {
+                // Shift one column left; 'copy' clears the vacated column
+                var ctx = canvas.getContext('2d');
+                ctx.globalCompositeOperation = 'copy';
+                ctx.drawImage(canvas, -TREND_COL, 0);
+                ctx.globalCompositeOperation = 'source-over';
+                trendDraw(t, canvas, 1);
+            }
+        }
+
+        // Draw the line from the reading `oldest` updates back to the newest
+        function trendDraw(t, canvas, oldest) {
+            var ctx = canvas.getContext('2d');
+            var w = canvas.width, h = canvas.height;
+            ctx.strokeStyle = '#a855f7';
+            ctx.lineWidth = 1.5;
+            ctx.beginPath();
+            for (var age = Math.min(oldest, t.count - 1); age >= 0; age--) {
+                var volts = t.data[(t.head - 1 - age + TREND_LEN) % TREND_LEN];
+                ctx.lineTo(w - 1 - age * TREND_COL, h - 1 - Math.min(volts / t.scale, 1) * (h - 2));
+            }
+            ctx.stroke();
+        }
+
         function refresh() {
+            if (refreshing) {
+                refreshAgain = true;
+                return;
+            }
+            refreshing = true;
+            clearTimeout(refreshTimer);
+            var started = Date.now();
             fetch('/api/status').then(function(r) { return r.json(); }).then(function(data) {
-                // Update relays
+                setLink('wifi-status', 'WiFi', data.wifi_connected, data.ip || 'Disconnected');
+                setLink('mqtt-status', 'MQTT', data.mqtt_connected,
+                        data.mqtt_connected ? 'Connected' : 'Disconnected');
+                lastStatus = data;
+                settleControls(started);
+                // Update relays and outputs (queued changes take precedence)
                 for (var i = 0; i < data.relays.length; i++) {
-                    var el = document.getElementById('relay-' + (i+1));
-                    if (el) {
-                        el.className = 'io-value ' + (data.relays[i] ? 'on' : 'off');
-                        el.textContent = data.relays[i] ? 'ON' : 'OFF';
-                    }
+                    showControl('relays', i+1, shown('relays', i+1, data.relays[i]));
                 }
-                // Update outputs
                 for (var i = 0; i < data.outputs.length; i++) {
-                    var el = document.getElementById('output-' + (i+1));
-                    if (el) {
-                        var v = data.outputs[i];
-                        el.className = 'io-value ' + (v > 0 ? 'on' : 'off');
-                        el.textContent = v > 0 ? 'ON' : 'OFF';
-                    }
+                    showControl('outputs', i+1, shown('outputs', i+1, data.outputs[i]));
                 }
                 // Update inputs
                 for (var i = 0; i < data.inputs.length; i++) {
@@ -163,18 +333,44 @@ SETTINGS_PAGE = """<!DOCTYPE html>
                     if (el) {
                         el.textContent = data.adcs[i].toFixed(1) + 'V';
                     }
+                    trendPush(i, data.adcs[i]);
                 }
-            });
+            }).then(function() { refreshDone(true, Date.now() - started); },
+                    function() { refreshDone(false, Date.now() - started); });
         }
         
-        setInterval(refresh, 1000);
+        refreshTimer = setTimeout(refresh, REFRESH_MS);
     </script>
 </body>
 </html>"""
 
+# SETTINGS_PAGE split at its %s markers, built on first use
+_page_parts = None
+
+
+def page_parts():
+    """Zero-copy slices of SETTINGS_PAGE between the %s markers."""
+    global _page_parts
+    if _page_parts is None:
+        view = memoryview(SETTINGS_PAGE)
+        parts = []
+        start = 0
+        while True:
+            marker = SETTINGS_PAGE.find(b"%s", start)
+            if marker < 0:
+                break
+            parts.append(view[start:marker])
+            start = marker + 2
+        parts.append(view[start:])
+        _page_parts = parts
+    return _page_parts
+
 
 def start_http_server(controller, port=80):
     """Start the HTTP server socket."""
+    global reader, writer
+    reader = RequestReader()
+    writer = ResponseWriter()
     addr = socket.getaddrinfo('0.0.0.0', port)[0][-1]
     s = socket.socket()
     s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
@@ -191,48 +387,54 @@ def handle_http_request(server_socket, controller):
         cl, addr = server_socket.accept()
     except OSError:
         return  # No connection waiting
+    controller.power.activity()
     
     try:
-        cl.settimeout(2.0)
-        request = cl.recv(2048).decode()
-        
-        # Parse request
-        lines = request.split('\r\n')
-        if not lines or len(lines) < 1:
-            cl.close()
-            return
-        
-        # Parse first line
-        first_line = lines[0].split(' ')
-        if len(first_line) < 2:
-            cl.close()
+        try:
+            request = reader.read(cl)
+        except RequestError as e:
+            print(f"HTTP: {e.status} {e}")
+            cl.settimeout(2.0)
+            cl.sendall(e.response().encode())
             return
+        cl.settimeout(2.0)
         
-        method, path = first_line[0], first_line[1]
+        method, path = request.method, request.path
         print(f"HTTP: {method} {path}")
+        start = time.ticks_us()
         
-        # Get body for POST requests
-        body = ""
-        if method == "POST":
-            body_start = request.find('\r\n\r\n')
-            if body_start > 0:
-                body = request[body_start + 4:].strip()
+        body = request.text()
+        if method == "POST" and path != "/api/ota":
             print(f"POST body: '{body}'")
         
         # Route request
+        status = "200 OK"
         if path == "/" or path == "/index.html":
             response = handle_index(controller)
             content_type = "text/html"
         elif path == "/api/status":
             response = controller.get_status_json()
             content_type = "application/json"
+        elif path == "/api/debug":
+            response = controller.get_debug_json()
+            content_type = "application/json"
+        elif path == "/api/log" and controller.log:
+            send_log(cl, controller.log, request)
+            controller.profiler.record("http GET /api/log", start)
+            return
+        elif path == "/api/ota" and controller.ota:
+            status, response = handle_ota(controller.ota, method, request)
+            content_type = "application/json"
         elif path == "/api/config" and method == "POST":
             response = handle_config_update(controller, body)
             content_type = "text/html"
         elif path == "/api/reset" and method == "POST":
-            controller.reset()
+            controller.core.reset()
             response = '{"status":"ok"}'
             content_type = "application/json"
+        elif path == "/api/io" and method == "POST":
+            status, response = handle_io(controller, body)
+            content_type = "application/json"
         elif path.startswith("/api/relay/") and method == "POST":
             if path.endswith("/toggle"):
                 response = handle_relay_toggle(controller, path)
@@ -254,15 +456,10 @@ def handle_http_request(server_socket, controller):
             cl.close()
             return
         
-        # Send response in chunks (Pico can't send large data at once)
-        data = response.encode()
-        # Use Connection: close instead of Content-Length to avoid mismatch errors
-        header = f"HTTP/1.0 200 OK\r\nContent-Type: {content_type}\r\nConnection: close\r\n\r\n".encode()
-        cl.sendall(header)
+        # Stream through the shared buffer (pages are generators, sent chunked)
+        writer.send(cl, response, content_type, status, http11=request.http11)
         
-        # Send in 512-byte chunks using sendall for reliability
-        for i in range(0, len(data), 512):
-            cl.sendall(data[i:i+512])
+        controller.profiler.record(route_name(method, path), start)
         
     except Exception as e:
         import sys
@@ -274,76 +471,154 @@ def handle_http_request(server_socket, controller):
             pass
 
 
+def parse_range(spec, total):
+    """
+    Parse a single "bytes=a-b" / "bytes=a-" / "bytes=-n" range.
+
+    Returns:
+        (start, end) with end exclusive; start >= end if unsatisfiable
+    """
+    if not spec.startswith("bytes=") or "," in spec:
+        raise ValueError(spec)
+    first, last = spec[6:].split("-")
+    if first:
+        return int(first), min(total, int(last) + 1) if last else total
+    return max(0, total - int(last)), total
+
+
+def send_log(cl, log, request):
+    """
+    Stream the binary data log, oldest record first.
+
+    Supports a single "Range: bytes=a-b" (also "a-" and "-n") so clients
+    can fetch only the records added since their last download.
+    """
+    log.flush()  # Include records still in RAM
+    total = log.size()
+    start, end = 0, total
+    status = "200 OK"
+
+    spec = request.headers.get("range")
+    if spec:
+        try:
+            start, end = parse_range(spec, total)
+            status = "206 Partial Content"
+        except ValueError:
+            pass  # Malformed: ignore the header and send everything
+        if start >= end:
+            cl.sendall(("HTTP/1.0 416 Range Not Satisfiable\r\n"
+                        f"Content-Range: bytes */{total}\r\n\r\n").encode())
+            return
+
+    extra = f"Accept-Ranges: bytes\r\nX-Record-Size: 32\r\nX-First-Seq: {log.first_seq()}\r\n"
+    if status.startswith("206"):
+        extra += f"Content-Range: bytes {start}-{end - 1}/{total}\r\n"
+    writer.begin(cl, status, "application/octet-stream", end - start, extra=extra)
+    writer.flush()
+
+    # Records are read into the writer's buffer and sent from there
+    for chunk in log.stream(start, end, writer.data):
+        cl.sendall(chunk)
+    writer.end()
+
+
+def handle_ota(ota, method, request):
+    """
+    GET: installed file hashes and update status.
+    POST: signed manifest; the download runs from the main loop afterwards.
+
+    Returns:
+        (HTTP status, JSON response)
+    """
+    from ota import OtaError
+    if method != "POST":
+        return "200 OK", json.dumps(ota.inventory())
+    try:
+        result = ota.accept(request.body or b"", request.headers.get("x-signature"))
+    except OtaError as e:
+        print(f"OTA rejected: {e}")
+        return "403 Forbidden", json.dumps({"status": "error", "error": str(e)})
+    print(f"OTA accepted: {result['files']}")
+    return "202 Accepted", json.dumps(result)
+
+
+def route_name(method, path):
+    """Timer name for a request, with channel numbers folded ("/api/relay/N")."""
+    parts = path.split('/')
+    for i, part in enumerate(parts):
+        if part.isdigit():
+            parts[i] = 'N'
+    return f"http {method} {'/'.join(parts)}"
+
+
 def handle_index(controller):
-    """Generate the settings page."""
+    """Generate the settings page, piece by piece (streamed by the writer)."""
     import config
     
-    # Build relay items (clickable)
-    relay_html = ""
-    for i, state in enumerate(controller.relay_states):
+    parts = page_parts()
+    core = controller.core
+
+    # WiFi status
+    wifi_connected = controller.wlan.isconnected()
+    yield parts[0]
+    yield "ok" if wifi_connected else "err"
+    yield parts[1]
+    yield controller.wlan.ifconfig()[0] if wifi_connected else "Disconnected"
+
+    # MQTT status
+    yield parts[2]
+    yield "ok" if controller.mqtt_connected else "err"
+    yield parts[3]
+    yield "Connected" if controller.mqtt_connected else "Disconnected"
+
+    # Relay items (clickable)
+    yield parts[4]
+    for i in range(core.num_relays):
+        state = core.relay(i)
         cls = "on" if state else "off"
         val = "ON" if state else "OFF"
-        relay_html += '<div class="io-item clickable" onclick="toggleRelay(%d)"><div class="io-label">R%d</div><div class="io-value %s" id="relay-%d">%s</div></div>' % (i+1, i+1, cls, i+1, val)
+        yield '<div class="io-item clickable" onclick="toggleRelay(%d)"><div class="io-label">R%d</div><div class="io-value %s" id="relay-%d">%s</div></div>' % (i+1, i+1, cls, i+1, val)
     
-    # Build output items (clickable)
-    output_html = ""
-    for i, value in enumerate(controller.output_values):
-        is_on = value > 0
+    # Output items (clickable)
+    yield parts[5]
+    for i in range(core.num_outputs):
+        is_on = core.output(i) > 0
         cls = "on" if is_on else "off"
         val = "ON" if is_on else "OFF"
-        output_html += '<div class="io-item clickable" onclick="toggleOutput(%d)"><div class="io-label">O%d</div><div class="io-value %s" id="output-%d">%s</div></div>' % (i+1, i+1, cls, i+1, val)
+        yield '<div class="io-item clickable" onclick="toggleOutput(%d)"><div class="io-label">O%d</div><div class="io-value %s" id="output-%d">%s</div></div>' % (i+1, i+1, cls, i+1, val)
     
-    # Build input items (read-only)
-    input_html = ""
-    for i in range(controller.board.NUM_INPUTS):
-        state = controller.board.read_input(i)
+    # Input items (read-only)
+    yield parts[6]
+    for i in range(core.num_inputs):
+        state = core.read_input(i)
         cls = "on" if state else "off"
         val = "HIGH" if state else "LOW"
-        input_html += '<div class="io-item"><div class="io-label">I%d</div><div class="io-value %s" id="input-%d">%s</div></div>' % (i+1, cls, i+1, val)
-    
-    # Build ADC items (read-only)
-    adc_html = ""
-    for i in range(controller.board.NUM_ADCS):
-        voltage = controller.board.read_adc(i)
-        adc_html += '<div class="io-item"><div class="io-label">A%d</div><div class="io-value volt" id="adc-%d">%.1fV</div></div>' % (i+1, i+1, voltage)
-    
-    # WiFi status
-    wifi_connected = controller.wlan.isconnected()
-    wifi_status = controller.wlan.ifconfig()[0] if wifi_connected else "Disconnected"
-    wifi_class = "ok" if wifi_connected else "err"
+        yield '<div class="io-item"><div class="io-label">I%d</div><div class="io-value %s" id="input-%d">%s</div></div>' % (i+1, cls, i+1, val)
     
-    # MQTT status
-    mqtt_status = "Connected" if controller.mqtt_connected else "Disconnected"
-    mqtt_class = "ok" if controller.mqtt_connected else "err"
+    # ADC items (read-only)
+    yield parts[7]
+    for i in range(core.num_adcs):
+        voltage = core.read_adc(i)
+        yield '<div class="io-item"><div class="io-label">A%d</div><div class="io-value volt" id="adc-%d">%.1fV</div><canvas class="trend" id="trend-%d" width="240" height="40"></canvas></div>' % (i+1, i+1, voltage, i+1)
     
-    return SETTINGS_PAGE % (
-        wifi_class, wifi_status,
-        mqtt_class, mqtt_status,
-        relay_html,
-        output_html,
-        input_html,
-        adc_html,
-        config.WIFI_SSID,
-        config.MQTT_BROKER,
-        config.MQTT_PORT,
-        config.MQTT_TOPIC
-    )
+    # Settings form
+    yield parts[8]
+    yield config.WIFI_SSID
+    yield parts[9]
+    yield config.MQTT_BROKER
+    yield parts[10]
+    yield str(config.MQTT_PORT)
+    yield parts[11]
+    yield config.MQTT_TOPIC
+    yield parts[12]
 
 
 def handle_config_update(controller, body):
     """Handle config form submission."""
     import config
     
-    # Parse form data
-    params = {}
-    for pair in body.split('&'):
-        if '=' in pair:
-            key, value = pair.split('=', 1)
-            value = value.replace('+', ' ')
-            value = value.replace('%2F', '/')
-            value = value.replace('%3A', ':')
-            value = value.replace('%40', '@')
-            params[key] = value
+    # Parse form data (fully percent-decoded, so any character works in passwords)
+    params = parse_form(body)
     
     changed = False
     
@@ -405,12 +680,9 @@ def handle_relay_toggle(controller, path):
         parts = path.split('/')
         index = int(parts[3]) - 1
         
-        if 0 <= index < controller.board.NUM_RELAYS:
-            new_state = not controller.relay_states[index]
-            controller.board.relay(index, new_state)
-            controller.relay_states[index] = new_state
-            print(f"Relay {index+1} toggled to {new_state}")
-            return json.dumps({"status": "ok", "relay": index + 1, "state": new_state})
+        new_state = controller.core.toggle_relay(index)
+        print(f"Relay {index+1} toggled to {new_state}")
+        return json.dumps({"status": "ok", "relay": index + 1, "state": new_state})
     except Exception as e:
         print(f"Relay toggle error: {e}")
     return json.dumps({"status": "error"})
@@ -423,30 +695,58 @@ def handle_output_toggle(controller, path):
         parts = path.split('/')
         index = int(parts[3]) - 1
         
-        if 0 <= index < controller.board.NUM_OUTPUTS:
-            new_value = 0.0 if controller.output_values[index] > 0 else 1.0
-            controller.board.output(index, new_value)
-            controller.output_values[index] = new_value
-            print(f"Output {index+1} toggled to {new_value}")
-            return json.dumps({"status": "ok", "output": index + 1, "value": int(new_value * 100)})
+        new_value = controller.core.toggle_output(index)
+        print(f"Output {index+1} toggled to {new_value}")
+        return json.dumps({"status": "ok", "output": index + 1, "value": int(new_value * 100)})
     except Exception as e:
         print(f"Output toggle error: {e}")
     return json.dumps({"status": "error"})
 
 
+def handle_io(controller, body):
+    """
+    Handle a batch of relay and output changes, e.g.
+    {"relays": {"1": true, "3": false}, "outputs": {"2": 50}} (outputs in %).
+    All changes are checked before any is applied.
+    """
+    core = controller.core
+    try:
+        data = json.loads(body)
+        relays = [(int(n) - 1, bool(v)) for n, v in data.get('relays', {}).items()]
+        outputs = [(int(n) - 1, max(0, min(100, int(v)))) for n, v in data.get('outputs', {}).items()]
+        for index, _ in relays:
+            if not 0 <= index < core.num_relays:
+                raise ValueError(f"no relay {index + 1}")
+        for index, _ in outputs:
+            if not 0 <= index < core.num_outputs:
+                raise ValueError(f"no output {index + 1}")
+    except (ValueError, TypeError, AttributeError) as e:
+        print(f"IO batch error: {e}")
+        return "400 Bad Request", json.dumps({"status": "error", "error": str(e)})
+
+    for index, state in relays:
+        core.set_relay(index, state)
+    for index, percent in outputs:
+        core.set_output(index, percent / 100.0)
+    print(f"IO batch: {len(relays)} relays, {len(outputs)} outputs")
+    return "200 OK", json.dumps({
+        "status": "ok",
+        "relays": {str(i + 1): v for i, v in relays},
+        "outputs": {str(i + 1): v for i, v in outputs},
+    })
+
+
 def handle_relay_control(controller, path, body):
     """Handle relay control API with explicit state."""
     print(f"Relay API: path={path} body={body}")
     try:
         index = int(path.split('/')[-1]) - 1
         data = json.loads(body) if body else {}
-        state = data.get('state', True)
+        state = bool(data.get('state', True))
         
-        if 0 <= index < controller.board.NUM_RELAYS:
-            controller.board.relay(index, state)
-            controller.relay_states[index] = state
-            print(f"Relay {index+1} set to {state}")
-            return json.dumps({"status": "ok", "relay": index + 1, "state": state})
+        controller.core.set_relay(index, state)
+        print(f"Relay {index+1} set to {state}")
+        return json.dumps({"status": "ok", "relay": index + 1, "state": state})
     except Exception as e:
         print(f"Relay error: {e}")
     return json.dumps({"status": "error"})
@@ -458,14 +758,11 @@ def handle_output_control(controller, path, body):
     try:
         index = int(path.split('/')[-1]) - 1
         data = json.loads(body) if body else {}
-        value = data.get('value', 100) / 100.0
-        value = max(0.0, min(1.0, value))
+        value = max(0.0, min(1.0, data.get('value', 100) / 100.0))
         
-        if 0 <= index < controller.board.NUM_OUTPUTS:
-            controller.board.output(index, value)
-            controller.output_values[index] = value
-            print(f"Output {index+1} set to {value}")
-            return json.dumps({"status": "ok", "output": index + 1, "value": int(value * 100)})
+        controller.core.set_output(index, value)
+        print(f"Output {index+1} set to {value}")
+        return json.dumps({"status": "ok", "output": index + 1, "value": int(value * 100)})
     except Exception as e:
         print(f"Output error: {e}")
     return json.dumps({"status": "error"})
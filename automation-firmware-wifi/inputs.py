@@ -0,0 +1,155 @@
+"""
+Interrupt-driven digital input edges
+====================================
+
+Pin IRQs timestamp every edge with ticks_us() into a fixed-size ring
+buffer, so short pulses are not lost between main-loop iterations. The
+IRQ handler allocates nothing; it only records the edge and schedules
+the consumer callback with micropython.schedule(), which then runs as
+soon as the VM is between bytecodes (including inside time.sleep_ms).
+"""
+
+import time
+from array import array
+
+import machine
+import micropython
+from machine import Pin
+
+# GPIOs of the buffered inputs on the Automation 2040 W (IN1-IN4)
+DEFAULT_INPUT_PINS = (19, 20, 21, 22)
+
+
+class InputMonitor:
+    """Records debounced input edges from pin interrupts."""
+
+    def __init__(self, pins=DEFAULT_INPUT_PINS, debounce_ms=5, size=32, on_edge=None):
+        """
+        Args:
+            pins: GPIO numbers of the inputs, in channel order
+            debounce_ms: Edges closer than this to the previous accepted
+                edge on the same channel are ignored
+            size: Ring buffer capacity in edges (power of two)
+            on_edge: Callback run via micropython.schedule() after new
+                edges were recorded; takes no arguments
+        """
+        assert size & (size - 1) == 0
+        self.num_inputs = len(pins)
+        self.debounce_us = debounce_ms * 1000
+        self.on_edge = on_edge
+
+        # Ring buffer of (channel, level, ticks_us, count) edges
+        self._mask = size - 1
+        self._chan = bytearray(size)
+        self._level = bytearray(size)
+        self._time = array('i', [0] * size)
+        self._count = array('I', [0] * size)
+        self._head = 0  # Written by the IRQ handler
+        self._tail = 0  # Written by the consumer
+
+        # Per-channel state
+        self.levels = bytearray(self.num_inputs)
+        self.counts = array('I', [0] * self.num_inputs)
+        self._last_us = array('i', [0] * self.num_inputs)
+        self.dropped = 0
+
+        self._pending = False
+        self._scheduled_ref = self._scheduled  # Avoid allocating in the IRQ
+
+        self._pins = []
+        for i, gpio in enumerate(pins):
+            pin = Pin(gpio, Pin.IN)
+            self._pins.append(pin)
+            self.levels[i] = pin.value()
+            pin.irq(self._make_handler(i), Pin.IRQ_RISING | Pin.IRQ_FALLING, hard=True)
+
+    def _make_handler(self, channel):
+        record = self._record
+        levels = self.levels
+        rising = Pin.IRQ_RISING
+        falling = Pin.IRQ_FALLING
+
+        def handler(pin):
+            # Level from the edge that fired, not pin.value(): a pulse
+            # shorter than the IRQ latency has already ended by now
+            flags = pin.irq().flags()
+            if flags & rising and flags & falling:
+                level = 1 - levels[channel]  # Both edges since last time: the first one
+            else:
+                level = 1 if flags & rising else 0
+            record(channel, level, time.ticks_us())
+
+        return handler
+
+    def _record(self, channel, level, now):
+        """Store one edge. Runs in hard IRQ context - must not allocate."""
+        if level == self.levels[channel]:
+            return  # Same edge direction again: the opposite one was debounced
+        if time.ticks_diff(now, self._last_us[channel]) < self.debounce_us:
+            return  # Trailing bounces are picked up by resync()
+        head = self._head
+        if ((head + 1) & self._mask) == self._tail:
+            self.dropped += 1
+            return
+        self.counts[channel] += 1
+        self._chan[head] = channel
+        self._level[head] = level
+        self._time[head] = now
+        self._count[head] = self.counts[channel]
+        self._head = (head + 1) & self._mask
+        self.levels[channel] = level
+        self._last_us[channel] = now
+        if self.on_edge is not None and not self._pending:
+            self._pending = True
+            try:
+                micropython.schedule(self._scheduled_ref, 0)
+            except RuntimeError:
+                self._pending = False  # Schedule queue full, main loop will drain
+
+    def _scheduled(self, _):
+        self._pending = False
+        self.on_edge()
+
+    def resync(self):
+        """
+        Record an edge for any input whose settled level differs from the
+        last recorded one. Catches the final transition of a bounce burst
+        that arrived inside the debounce window.
+        """
+        now = time.ticks_us()
+        for i in range(self.num_inputs):
+            level = self._pins[i].value()
+            if level != self.levels[i] and time.ticks_diff(now, self._last_us[i]) >= self.debounce_us:
+                irq_state = machine.disable_irq()
+                self._record(i, level, now)
+                machine.enable_irq(irq_state)
+
+    def any(self):
+        """Return True if there are edges waiting to be read."""
+        return self._head != self._tail
+
+    def pop(self):
+        """
+        Remove the oldest edge.
+
+        Returns:
+            (channel, level, ticks_us, count) tuple, where count is the
+            number of edges seen on that channel since boot, or None if
+            the buffer is empty
+        """
+        tail = self._tail
+        if tail == self._head:
+            return None
+        edge = (self._chan[tail], self._level[tail], self._time[tail], self._count[tail])
+        self._tail = (tail + 1) & self._mask
+        return edge
+
+    def read(self, channel):
+        """Return the last recorded level of an input as a bool."""
+        return self.levels[channel] == 1
+
+    def deinit(self):
+        """Detach the pin interrupts."""
+        for pin in self._pins:
+            pin.irq(None)
+
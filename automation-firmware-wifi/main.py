@@ -3,20 +3,36 @@ Automation 2040 W WiFi Firmware
 ===============================
 
 Features:
-- WiFi auto-connect
+- WiFi auto-connect and reconnect (non-blocking, with backoff)
 - MQTT client for IoT integration
 - HTTP settings interface
 - USB serial still works for debugging
 
 MQTT Topics:
 - automation/status      - JSON with all I/O states (published periodically)
+- automation/input/N     - Input N edge: {"state": "HIGH"|"LOW", "count": n, "ticks_us": t}
+- automation/offline     - Edges and samples buffered in RAM while MQTT was down (after reconnect)
+- automation/log         - Data log records made while MQTT was down (after reconnect)
 - automation/relay/N     - Set relay N (1-3): "ON" or "OFF"
 - automation/output/N    - Set output N (1-3): 0-100
 - automation/command     - General commands: "RESET", "STATUS"
 
+TCP (port 2040):
+- Same line protocol as the USB serial firmware (RELAY/OUTPUT/STATUS/...)
+
+UDP telemetry (optional, TELEMETRY_INTERVAL > 0):
+- Binary status frames to TELEMETRY_ADDR:TELEMETRY_PORT (see telemetry.py)
+
+Data log (optional, LOG_ENABLED):
+- Status samples and input edges kept in flash (see datalog.py)
+
 HTTP Endpoints:
 - GET  /           - Settings page
 - GET  /api/status - JSON status
+- GET  /api/log    - Binary data log download (supports Range)
+- GET  /api/debug  - Memory, loop timing, handler timing, sockets, RSSI, power states
+- GET  /api/ota    - Installed file hashes and OTA status (OTA_KEY set)
+- POST /api/ota    - Signed update manifest (see ota.py, ota-update.py)
 - POST /api/config - Update settings
 """
 
@@ -24,10 +40,21 @@ import json
 import time
 import network
 import machine
-from machine import Pin
+
+# Finish an interrupted OTA file swap before importing the modules it replaces
+try:
+    import ota
+    ota.resume()
+except ImportError:
+    pass
 
 # Import Pimoroni automation library
-from automation import Automation2040W, SWITCH_A, SWITCH_B
+from automation import SWITCH_A, SWITCH_B, Automation2040W
+from automation_core import AutomationCore, parse_output, parse_state
+from connection import MqttLink, WifiLink
+from debug import Profiler, memory
+from inputs import DEFAULT_INPUT_PINS, InputMonitor
+from power import PowerManager
 
 # Try to import config, use defaults if not found
 try:
@@ -44,8 +71,13 @@ except ImportError:
         MQTT_USER = ""
         MQTT_PASSWORD = ""
         HTTP_PORT = 80
+        TCP_PORT = 2040
+        TELEMETRY_INTERVAL = 0
+        LOG_ENABLED = False
+        OFFLINE_QUEUE_SIZE = 128
         MQTT_PUBLISH_INTERVAL = 1000
         INPUT_POLL_INTERVAL = 100
+        INPUT_DEBOUNCE_MS = 5
 
 # Try to import MQTT library
 try:
@@ -64,21 +96,112 @@ class AutomationController:
     def __init__(self):
         self.board = Automation2040W()
         self.wlan = network.WLAN(network.STA_IF)
-        self.mqtt = None
-        self.mqtt_connected = False
+        self.mqtt_busy = False  # Guards the socket against scheduled edge publishes
+        # QoS 1/2 for publishes and subscriptions: acked asynchronously within a window
+        self.mqtt_qos = min(max(getattr(config, 'MQTT_QOS', 0), 0), 2)
+        self.profiler = Profiler()
+
+        # Loop sleep policy and time per power state (LOW_POWER enables sleeping)
+        self.power = PowerManager(
+            self.wlan,
+            low_power=getattr(config, 'LOW_POWER', False),
+            latency_ms=getattr(config, 'LOW_POWER_LATENCY_MS', 100),
+            hold_ms=getattr(config, 'LOW_POWER_HOLD_MS', 2000),
+            lightsleep=getattr(config, 'LOW_POWER_LIGHTSLEEP', False),
+            wifi_power_save=getattr(config, 'WIFI_POWER_SAVE', True),
+        )
+        self.http_socket = None
+        self.tcp_server = None
+        self.telemetry = None
+
+        # Cached pieces of the status publish, rebuilt only when they change
+        self.status_topic = None
+        self.status_extra = None
+        self.status_extra_since = None
+
+        # I/O state, validation, status and command protocol (shared with serial firmware)
+        self.core = AutomationCore(self.board, VERSION)
+
+        # History of samples and edges in flash, replayed to MQTT after outages
+        self.log = None
+        if getattr(config, 'LOG_ENABLED', False):
+            from datalog import DataLog
+            self.log = DataLog(
+                self.core,
+                segments=getattr(config, 'LOG_SEGMENTS', 8),
+                segment_size=getattr(config, 'LOG_SEGMENT_SIZE', 16384),
+                interval_ms=getattr(config, 'LOG_INTERVAL', 10000),
+                flush_ms=getattr(config, 'LOG_FLUSH_INTERVAL', 60000),
+            )
+
+        # Edges and state samples kept in RAM while MQTT is down (0 disables)
+        self.offline = None
+        offline_size = getattr(config, 'OFFLINE_QUEUE_SIZE', 128)
+        if offline_size:
+            from offline import OfflineQueue
+            self.offline = OfflineQueue(
+                self.core,
+                size=offline_size,
+                sample_ms=getattr(config, 'OFFLINE_SAMPLE_INTERVAL', 10000),
+            )
+
+        self.offline_pid = None  # Packet id of the replay batch awaiting its ack
+        self.edges_dropped = 0  # QoS > 0 edges lost to a full window without an offline queue
+
+        self.log_record = bytearray(32)
+        self.backfill_seq = None  # Next log record to replay to MQTT
+        self.backfill_end = 0
+        self.outage_seq = self.log.next_seq if self.log else 0
+        self.mqtt_was_up = False
         
-        # State tracking
-        self.relay_states = [False] * self.board.NUM_RELAYS
-        self.output_values = [0.0] * self.board.NUM_OUTPUTS
-        self.last_inputs = [False] * self.board.NUM_INPUTS
+        # Over-the-air updates, enabled by setting a shared key
+        self.ota = None
+        ota_key = getattr(config, 'OTA_KEY', '')
+        if ota_key:
+            from ota import Updater
+            self.ota = Updater(ota_key)
+
+        # Input edges are captured by pin IRQs and published as they arrive
+        self.inputs = InputMonitor(
+            pins=getattr(config, 'INPUT_PINS', DEFAULT_INPUT_PINS)[:self.board.NUM_INPUTS],
+            debounce_ms=getattr(config, 'INPUT_DEBOUNCE_MS', 5),
+            on_edge=self.publish_input_edges,
+        )
         
         # Timing
         self.last_mqtt_publish = 0
         self.last_input_poll = 0
-        self.last_mqtt_retry = 0
         
         # Load saved config if exists
         self.load_config()
+
+        # Connectivity, advanced from the main loop without blocking
+        self.wifi = WifiLink(
+            self.wlan,
+            lambda: (config.WIFI_SSID, config.WIFI_PASSWORD),
+            led=lambda b: self.board.switch_led(SWITCH_A, b),  # LED A = WiFi
+            on_up=self.sync_clock,
+        )
+        self.mqtt_link = MqttLink(
+            self.make_mqtt_client,
+            self.subscribe_mqtt,
+            led=lambda b: self.board.switch_led(SWITCH_B, b),  # LED B = MQTT
+            enabled=MQTT_AVAILABLE,
+        )
+        # RESET (any transport) clears the switch LEDs along with the I/O
+        self.core.on_reset = self.show_link_leds
+
+    def show_link_leds(self):
+        self.wifi.show_led()
+        self.mqtt_link.show_led()
+
+    @property
+    def mqtt(self):
+        return self.mqtt_link.client
+
+    @property
+    def mqtt_connected(self):
+        return self.mqtt_link.connected
     
     def load_config(self):
         """Load config from file if it exists."""
@@ -109,81 +232,44 @@ class AutomationController:
         except Exception as e:
             print(f"Failed to save config: {e}")
     
-    def connect_wifi(self):
-        """Connect to WiFi network."""
-        print(f"Connecting to WiFi: {config.WIFI_SSID}")
-        self.board.switch_led(SWITCH_A, 50)  # LED A = connecting
-        
-        self.wlan.active(True)
-        self.wlan.connect(config.WIFI_SSID, config.WIFI_PASSWORD)
-        
-        # Wait for connection (max 20 seconds)
-        for i in range(40):
-            if self.wlan.isconnected():
-                break
-            time.sleep(0.5)
-            # Blink LED
-            self.board.switch_led(SWITCH_A, 50 if i % 2 == 0 else 0)
-        
-        if self.wlan.isconnected():
-            ip = self.wlan.ifconfig()[0]
-            print(f"Connected! IP: {ip}")
-            self.board.switch_led(SWITCH_A, 100)  # LED A = connected
-            return True
-        else:
-            print("WiFi connection failed")
-            self.board.switch_led(SWITCH_A, 0)
-            return False
-    
     def reconnect_mqtt(self):
         """Disconnect and reconnect to MQTT with current config."""
-        if self.mqtt:
-            try:
-                self.mqtt.disconnect()
-            except:
-                pass
-            self.mqtt = None
-        self.mqtt_connected = False
-        return self.connect_mqtt()
+        self.mqtt_link.reset()
     
-    def connect_mqtt(self):
-        """Connect to MQTT broker."""
-        if not MQTT_AVAILABLE:
-            return False
-        
-        print(f"Connecting to MQTT: {config.MQTT_BROKER}:{config.MQTT_PORT}")
-        self.board.switch_led(SWITCH_B, 50)  # LED B = connecting
-        
-        try:
-            self.mqtt = MQTTClient(
-                config.MQTT_CLIENT_ID,
-                config.MQTT_BROKER,
-                port=config.MQTT_PORT,
-                user=config.MQTT_USER if config.MQTT_USER else None,
-                password=config.MQTT_PASSWORD if config.MQTT_PASSWORD else None
-            )
-            self.mqtt.set_callback(self.mqtt_callback)
-            self.mqtt.connect()
-            
-            # Subscribe to command topics
-            topic_base = config.MQTT_TOPIC
-            self.mqtt.subscribe(f"{topic_base}/relay/+")
-            self.mqtt.subscribe(f"{topic_base}/output/+")
-            self.mqtt.subscribe(f"{topic_base}/command")
-            
-            print("MQTT connected!")
-            self.board.switch_led(SWITCH_B, 100)  # LED B = connected
-            self.mqtt_connected = True
-            return True
-            
-        except Exception as e:
-            print(f"MQTT connection failed: {e}")
-            self.board.switch_led(SWITCH_B, 0)
-            self.mqtt_connected = False
-            return False
+    def make_mqtt_client(self):
+        """Create an unconnected MQTT client from the current config."""
+        client = MQTTClient(
+            config.MQTT_CLIENT_ID,
+            config.MQTT_BROKER,
+            port=config.MQTT_PORT,
+            user=config.MQTT_USER if config.MQTT_USER else None,
+            password=config.MQTT_PASSWORD if config.MQTT_PASSWORD else None,
+            keepalive=getattr(config, 'MQTT_KEEPALIVE', 60),
+            window=getattr(config, 'MQTT_QOS1_WINDOW', 4),
+            version=getattr(config, 'MQTT_VERSION', 4),
+            session_expiry=getattr(config, 'MQTT_SESSION_EXPIRY', 0),
+        )
+        client.set_callback(self.mqtt_callback)
+        client.set_ack_callback(self.mqtt_acked)
+        self.offline_pid = None  # Unacked batch went with the old client, resend
+        return client
+
+    def subscribe_mqtt(self, client, session_present):
+        """Subscribe to command topics once the broker accepted us."""
+        topic_base = config.MQTT_TOPIC
+        self.status_topic = f"{topic_base}/status"
+        if session_present:
+            print("MQTT session resumed, subscriptions kept")
+            return
+        client.subscribe_nowait((
+            f"{topic_base}/relay/+",
+            f"{topic_base}/output/+",
+            f"{topic_base}/command",
+        ), self.mqtt_qos)
     
     def mqtt_callback(self, topic, msg):
         """Handle incoming MQTT messages."""
+        self.power.activity()
         topic = topic.decode()
         msg = msg.decode().upper().strip()
         topic_base = config.MQTT_TOPIC
@@ -194,28 +280,16 @@ class AutomationController:
             if topic.startswith(f"{topic_base}/relay/"):
                 # Relay control: automation/relay/1 = ON
                 index = int(topic.split('/')[-1]) - 1
-                if 0 <= index < self.board.NUM_RELAYS:
-                    state = msg in ("ON", "1", "TRUE")
-                    self.board.relay(index, state)
-                    self.relay_states[index] = state
+                self.core.set_relay(index, parse_state(msg))
                     
             elif topic.startswith(f"{topic_base}/output/"):
                 # Output control: automation/output/1 = 50
                 index = int(topic.split('/')[-1]) - 1
-                if 0 <= index < self.board.NUM_OUTPUTS:
-                    if msg in ("ON", "TRUE"):
-                        value = 1.0
-                    elif msg in ("OFF", "FALSE"):
-                        value = 0.0
-                    else:
-                        value = float(msg) / 100.0
-                    value = max(0.0, min(1.0, value))
-                    self.board.output(index, value)
-                    self.output_values[index] = value
+                self.core.set_output(index, parse_output(msg))
                     
             elif topic == f"{topic_base}/command":
                 if msg == "RESET":
-                    self.reset()
+                    self.core.reset()
                 elif msg == "STATUS":
                     self.publish_status()
                     
@@ -227,120 +301,325 @@ class AutomationController:
         if not self.mqtt_connected:
             return
         
+        busy = self.mqtt_busy  # Also called from mqtt_callback inside check_msg
+        self.mqtt_busy = True
         try:
-            status = {
-                "relays": self.relay_states,
-                "outputs": [int(v * 100) for v in self.output_values],
-                "inputs": [self.board.read_input(i) for i in range(self.board.NUM_INPUTS)],
-                "adcs": [round(self.board.read_adc(i), 3) for i in range(self.board.NUM_ADCS)],
-                "ip": self.wlan.ifconfig()[0] if self.wlan.isconnected() else None
-            }
+            # The IP only changes with the WiFi link state
+            if self.status_extra_since != self.wifi.state_since:
+                self.status_extra_since = self.wifi.state_since
+                ip = self.wlan.ifconfig()[0] if self.wlan.isconnected() else None
+                self.status_extra = f',"ip":{json.dumps(ip)}'.encode()
             
-            self.mqtt.publish(
-                f"{config.MQTT_TOPIC}/status",
-                json.dumps(status)
-            )
+            start = time.ticks_us()
+            payload = self.core.encoder.encode(self.status_extra)
+            if self.mqtt_qos:
+                # Window full: skip, the next status supersedes this one
+                self.mqtt.publish_nowait(self.status_topic, payload, qos=self.mqtt_qos)
+            else:
+                self.mqtt.publish(self.status_topic, payload)
+            self.profiler.record("mqtt_publish", start)
         except Exception as e:
-            print(f"MQTT publish failed: {e}")
-            self.mqtt_connected = False
+            self.mqtt_link.drop(f"publish failed: {e}")
+        finally:
+            self.mqtt_busy = busy
     
-    def check_input_changes(self):
-        """Check for input changes and publish them."""
-        for i in range(self.board.NUM_INPUTS):
-            current = self.board.read_input(i)
-            if current != self.last_inputs[i]:
-                self.last_inputs[i] = current
-                if self.mqtt_connected:
-                    try:
-                        self.mqtt.publish(
-                            f"{config.MQTT_TOPIC}/input/{i+1}",
-                            "HIGH" if current else "LOW"
-                        )
-                    except:
-                        pass
+    def publish_input_edges(self):
+        """
+        Publish every recorded input edge, oldest first.
+
+        Runs from micropython.schedule() as soon as an edge IRQ fires, and
+        from the main loop as a fallback. If the MQTT socket is in use by
+        the main loop the call backs off and the main loop drains later.
+        """
+        self.power.wake()  # End a low-power sleep so the edge is served now
+        if self.mqtt_busy:
+            return
+        self.mqtt_busy = True
+        try:
+            while True:
+                edge = self.inputs.pop()
+                if edge is None:
+                    break
+                channel, level, ticks, count = edge
+                if self.log:
+                    self.log.log_edge(channel, level, count)
+                # Queue behind older buffered events so replay stays in order
+                if self.offline and (not self.mqtt_connected or self.offline.any()):
+                    self.offline.edge(channel, level, count, ticks)
+                    continue
+                if not self.mqtt_connected:
+                    continue
+                start = time.ticks_us()
+                topic = f"{config.MQTT_TOPIC}/input/{channel + 1}"
+                state = "HIGH" if level else "LOW"
+                payload = f'{{"state":"{state}","count":{count},"ticks_us":{ticks}}}'
+                if not self.mqtt_qos:
+                    self.mqtt.publish(topic, payload)
+                elif self.mqtt.publish_nowait(topic, payload, qos=self.mqtt_qos) is None:
+                    # Window full: keep the edge for replay
+                    if self.offline:
+                        self.offline.edge(channel, level, count, ticks)
+                    else:
+                        self.edges_dropped += 1
+                self.profiler.record("mqtt_publish", start)
+        except Exception as e:
+            self.mqtt_link.drop(f"input publish failed: {e}")
+        finally:
+            self.mqtt_busy = False
+
+    def update_backfill(self):
+        """Track MQTT outages as ranges of log records to replay."""
+        up = self.mqtt_connected
+        if up == self.mqtt_was_up:
+            return
+        self.mqtt_was_up = up
+        if not up:
+            self.outage_seq = self.log.next_seq
+        elif self.log.next_seq > self.outage_seq:
+            # Replay starts at the oldest record still in flash
+            if self.backfill_seq is None:
+                self.backfill_seq = max(self.outage_seq, self.log.first_seq())
+            self.backfill_end = self.log.next_seq
+            print(f"Backfilling {self.backfill_end - self.backfill_seq} log records")
+
+    def publish_backfill(self, batch=8):
+        """Publish up to `batch` log records recorded during an outage."""
+        if self.backfill_seq is None or not self.mqtt_connected or self.mqtt_busy:
+            return
+        self.mqtt_busy = True
+        try:
+            topic = f"{config.MQTT_TOPIC}/log"
+            self.backfill_seq = max(self.backfill_seq, self.log.first_seq())
+            while batch and self.backfill_seq < self.backfill_end:
+                if self.log.read_record(self.backfill_seq, self.log_record):
+                    start = time.ticks_us()
+                    self.mqtt.publish(topic, json.dumps(self.log.decode(self.log_record)))
+                    self.profiler.record("mqtt_publish", start)
+                    batch -= 1
+                self.backfill_seq += 1
+            if self.backfill_seq >= self.backfill_end:
+                self.backfill_seq = None
+        except Exception as e:
+            self.mqtt_link.drop(f"backfill failed: {e}")
+        finally:
+            self.mqtt_busy = False
+
+    def mqtt_acked(self, pid):
+        """Drop the replayed offline batch once the broker has acked it."""
+        if pid == self.offline_pid:
+            self.offline_pid = None
+            self.offline.commit()
+
+    def poll_offline(self, now, batch=16):
+        """
+        Sample the I/O state into the offline queue while MQTT is down, and
+        replay the queue oldest first once it is back, `batch` events per
+        publish. With MQTT_QOS > 0 one batch is in flight at a time and
+        leaves the queue when acked. Runs under mqtt_busy so scheduled
+        edge publishes cannot modify the queue midway.
+        """
+        if self.mqtt_busy:
+            return
+        self.mqtt_busy = True
+        try:
+            self.offline.poll(now, self.mqtt_connected)
+            if self.mqtt_connected and self.offline.any() and self.offline_pid is None:
+                if self.mqtt_qos and self.mqtt.inflight == self.mqtt.window:
+                    return  # Window full, retried on the next loop
+                payload, n = self.offline.batch_json(batch, now)
+                topic = f"{config.MQTT_TOPIC}/offline"
+                start = time.ticks_us()
+                if self.mqtt_qos:
+                    self.offline_pid = self.mqtt.publish_nowait(topic, payload, qos=self.mqtt_qos)
+                else:
+                    self.mqtt.publish(topic, payload)
+                    self.offline.commit()
+                self.profiler.record("mqtt_publish", start)
+        except Exception as e:
+            self.mqtt_link.drop(f"offline replay failed: {e}")
+        finally:
+            self.mqtt_busy = False
+
+    def sync_clock(self):
+        """Set the RTC from NTP so buffered and logged events carry wall-clock time."""
+        # Runs once per WiFi connect, not from the loop: settime() blocks
+        # for up to the socket timeout
+        if not (self.log or self.offline):
+            return
+        try:
+            import ntptime
+            ntptime.timeout = 1
+            ntptime.settime()
+            print("Clock set from NTP")
+        except Exception as e:
+            print(f"NTP failed: {e}")
     
-    def reset(self):
-        """Reset all outputs to safe state."""
-        for i in range(self.board.NUM_RELAYS):
-            self.board.relay(i, False)
-            self.relay_states[i] = False
-        for i in range(self.board.NUM_OUTPUTS):
-            self.board.output(i, 0.0)
-            self.output_values[i] = 0.0
+    def install_update(self):
+        """Run the pending OTA update (blocks while downloading) and reset on success."""
+        print("OTA: downloading update")
+        if self.ota.run():
+            print(f"OTA: installed serial {self.ota.serial} ({self.ota.downloaded} bytes), resetting")
+            if self.mqtt_connected:
+                try:
+                    self.mqtt.disconnect()
+                except Exception:
+                    pass
+            time.sleep_ms(200)
+            machine.reset()
     
     def get_status_json(self):
-        """Get current status as JSON string."""
-        return json.dumps({
+        """Get current status as JSON (memoryview into the status encoder buffer)."""
+        now = time.ticks_ms()
+        status = {
             "version": VERSION,
             "wifi_connected": self.wlan.isconnected(),
             "mqtt_connected": self.mqtt_connected,
             "ip": self.wlan.ifconfig()[0] if self.wlan.isconnected() else None,
-            "relays": self.relay_states,
-            "outputs": [int(v * 100) for v in self.output_values],
-            "inputs": [self.board.read_input(i) for i in range(self.board.NUM_INPUTS)],
-            "adcs": [round(self.board.read_adc(i), 3) for i in range(self.board.NUM_ADCS)],
             "config": {
                 "wifi_ssid": config.WIFI_SSID,
                 "mqtt_broker": config.MQTT_BROKER,
                 "mqtt_port": config.MQTT_PORT,
                 "mqtt_topic": config.MQTT_TOPIC
+            },
+            "links": {
+                "wifi": self.wifi.stats(now),
+                "mqtt": self.mqtt_link.stats(now)
             }
-        })
+        }
+        if self.log:
+            status["log"] = self.log.stats()
+        if self.offline:
+            status["offline"] = self.offline.stats()
+        # I/O part from the encoder, the rest appended as extra members
+        extra = "," + json.dumps(status)[1:-1]
+        return self.core.encoder.encode(extra.encode())
+
+    def get_debug_json(self):
+        """Get memory, timing and socket introspection as JSON string."""
+        debug = self.profiler.stats()
+        debug["memory"] = memory()
+        debug["power"] = self.power.stats()
+
+        tcp_clients = len(self.tcp_server.clients) if self.tcp_server else 0
+        sockets = {
+            "http_listener": 1 if self.http_socket else 0,
+            "tcp_listener": 1 if self.tcp_server else 0,
+            "tcp_clients": tcp_clients,
+            "mqtt": 1 if self.mqtt_connected else 0,
+            "udp_telemetry": 1 if self.telemetry else 0,
+        }
+        sockets["total"] = sum(sockets.values())
+        debug["sockets"] = sockets
+
+        try:
+            rssi = self.wlan.status('rssi') if self.wlan.isconnected() else None
+        except Exception:
+            rssi = None
+        debug["wifi_rssi"] = rssi
+        debug["edges_dropped"] = self.edges_dropped
+        if self.telemetry:
+            debug["telemetry"] = {"sent": self.telemetry.sent, "errors": self.telemetry.errors}
+        if self.mqtt:
+            debug["mqtt"] = self.mqtt.stats()
+        return json.dumps(debug)
     
     def run(self):
         """Main loop."""
         print(f"Automation 2040 W WiFi v{VERSION}")
         
-        # Connect to WiFi
-        if not self.connect_wifi():
-            print("Running in offline mode")
+        # Start HTTP server (binds to 0.0.0.0, usable once WiFi comes up)
+        from http_server import start_http_server
+        self.http_socket = start_http_server(self, config.HTTP_PORT)
         
-        # Connect to MQTT
-        if self.wlan.isconnected():
-            self.connect_mqtt()
+        # Line-protocol server for the host library (0 disables it)
+        tcp_port = getattr(config, 'TCP_PORT', 2040)
+        if tcp_port:
+            from tcp_server import TextServer
+            self.tcp_server = TextServer(self.core, tcp_port)
         
-        # Start HTTP server
-        from http_server import start_http_server
-        http_socket = start_http_server(self, config.HTTP_PORT)
+        # Binary UDP status stream for LAN dashboards (0 disables it)
+        telemetry_interval = getattr(config, 'TELEMETRY_INTERVAL', 0)
+        if telemetry_interval:
+            from telemetry import Telemetry
+            self.telemetry = Telemetry(
+                self.core,
+                self.wlan.config('mac'),
+                addr=getattr(config, 'TELEMETRY_ADDR', '239.20.40.1'),
+                port=getattr(config, 'TELEMETRY_PORT', 20400),
+                interval_ms=telemetry_interval,
+            )
         
         print("Ready!")
-        if self.wlan.isconnected():
-            print(f"Web interface: http://{self.wlan.ifconfig()[0]}/")
         
         # Main loop
         while True:
             now = time.ticks_ms()
+            self.profiler.loop()
+
+            # Expire timed relay/output actions
+            self.core.tick(now)
+
+            # Advance WiFi and MQTT connection state machines
+            self.wifi.poll(now)
+            self.mqtt_link.poll(now, self.wifi.connected)
+            self.power.poll_wifi(self.wifi.connected)
             
             # Check MQTT messages
             if self.mqtt_connected:
+                self.mqtt_busy = True
                 try:
                     self.mqtt.check_msg()
-                except:
-                    self.mqtt_connected = False
-            
-            # Auto-reconnect MQTT every 15 seconds if disconnected
-            if not self.mqtt_connected and self.wlan.isconnected():
-                if time.ticks_diff(now, self.last_mqtt_retry) >= 15000:
-                    self.last_mqtt_retry = now
-                    print("MQTT disconnected, attempting reconnect...")
-                    self.connect_mqtt()
+                except Exception as e:
+                    self.mqtt_link.drop(e)
+                finally:
+                    self.mqtt_busy = False
             
             # Periodic MQTT status publish
             if time.ticks_diff(now, self.last_mqtt_publish) >= config.MQTT_PUBLISH_INTERVAL:
                 self.last_mqtt_publish = now
                 self.publish_status()
             
-            # Check input changes
+            # Catch edges lost to debounce or deferred while MQTT was busy
             if time.ticks_diff(now, self.last_input_poll) >= config.INPUT_POLL_INTERVAL:
                 self.last_input_poll = now
-                self.check_input_changes()
+                self.inputs.resync()
+            if self.inputs.any():
+                self.publish_input_edges()
             
             # Handle HTTP requests (non-blocking)
             from http_server import handle_http_request
-            handle_http_request(http_socket, self)
+            handle_http_request(self.http_socket, self)
+
+            # Handle TCP protocol clients (non-blocking)
+            if self.tcp_server:
+                self.tcp_server.poll()
+                if self.tcp_server.clients:
+                    self.power.activity()
+
+            # UDP telemetry frame
+            if self.telemetry:
+                self.telemetry.poll(now, self.wifi.connected, self.mqtt_connected)
+
+            # Offline event buffer: sample while MQTT is down, replay after
+            if self.offline:
+                self.poll_offline(now, getattr(config, 'OFFLINE_BATCH', 16))
+
+            # Data log: sample, flush, and replay what MQTT missed
+            if self.log:
+                self.log.poll(now)
+                self.update_backfill()
+                self.publish_backfill()
+
+            # Accepted OTA update: download, verify, swap, restart
+            if self.ota and self.ota.pending:
+                self.install_update()
             
-            # Small delay to prevent tight loop
-            time.sleep_ms(10)
+            # Sleep until the next pass (10 ms, or until the next job in low-power mode)
+            due = time.ticks_add(self.last_mqtt_publish, config.MQTT_PUBLISH_INTERVAL)
+            input_due = time.ticks_add(self.last_input_poll, config.INPUT_POLL_INTERVAL)
+            if time.ticks_diff(input_due, due) < 0:
+                due = input_due
+            self.power.sleep(now, due)
 
 
 # Entry point
@@ -0,0 +1,173 @@
+"""
+Offline MQTT Event Buffer for Automation 2040 W
+===============================================
+
+While MQTT is down, input edges and periodic state samples are kept in
+a bounded RAM ring buffer instead of being dropped. After the reconnect
+they are replayed oldest first, several events per publish, with their
+original timestamps.
+
+The ring is one preallocated bytearray of fixed-size entries, so its
+memory use is fixed. When it is full the oldest entry is overwritten and
+counted as an overflow.
+
+Entry layout (little-endian, 28 bytes):
+
+    offset  size  field
+    0       1     kind: 1 = state sample, 2 = input edge
+    1       1     edge: input channel (0-based)
+    2       1     edge: level
+    3       1     relay bitmask
+    4       1     input bitmask
+    5       2     edge: count (wraps)
+    7       4     edge: time.ticks_us() of the edge
+    11      4     time.ticks_ms() when recorded
+    15      4     time.time() when recorded
+    19      3     outputs, percent 0-100
+    22      6     ADCs, unsigned 16-bit millivolts
+"""
+
+import json
+import struct
+import time
+
+ENTRY = "<BBBBBHiiI3B3H"
+ENTRY_SIZE = 28
+
+KIND_SAMPLE = 1
+KIND_EDGE = 2
+
+
+class OfflineQueue:
+    """Bounded ring of events recorded while MQTT is disconnected."""
+
+    def __init__(self, core, size=128, sample_ms=10000):
+        """
+        Args:
+            core: AutomationCore to sample
+            size: Number of entries kept
+            sample_ms: Time between state samples while offline (0 = edges only)
+        """
+        self.core = core
+        self.size = size
+        self.sample_ms = sample_ms
+        self.buf = bytearray(size * ENTRY_SIZE)
+        self.head = 0  # Next entry to replay
+        self.count = 0
+        self.overflows = 0  # Entries overwritten since boot
+        self.unreported = 0  # Overflows not yet sent with a replay batch
+        self.sent = 0  # Entries at the front sent in the batch awaiting commit()
+        self.reported = 0  # Overflows reported in that batch
+        self.recorded = 0
+        self.replayed = 0
+        self.last_sample = time.ticks_ms()
+
+    def any(self):
+        return self.count > 0
+
+    def poll(self, now, online):
+        """Sample the I/O state while offline, every sample_ms."""
+        if online or not self.sample_ms:
+            self.last_sample = now
+            return
+        if time.ticks_diff(now, self.last_sample) >= self.sample_ms:
+            self.last_sample = now
+            self._record(KIND_SAMPLE)
+
+    def edge(self, channel, level, count, ticks_us):
+        self._record(KIND_EDGE, channel, 1 if level else 0, count & 0xFFFF, ticks_us)
+
+    def _record(self, kind, channel=0, level=0, count=0, ticks_us=0):
+        if self.count == self.size:
+            # Full: overwrite the oldest entry
+            self.head = (self.head + 1) % self.size
+            self.count -= 1
+            self.overflows += 1
+            self.unreported += 1
+            if self.sent:
+                self.sent -= 1  # Already replayed, just not acknowledged
+
+        core = self.core
+        relays = 0
+        for i in range(core.num_relays):
+            if core.relay(i):
+                relays |= 1 << i
+        inputs = 0
+        for i in range(core.num_inputs):
+            if core.read_input(i):
+                inputs |= 1 << i
+        outputs = core.output_permille
+        encoder = core.encoder
+        n_out = core.num_outputs
+        n_adc = core.num_adcs
+
+        struct.pack_into(
+            ENTRY, self.buf, (self.head + self.count) % self.size * ENTRY_SIZE,
+            kind, channel, level, relays, inputs, count, ticks_us,
+            time.ticks_ms(), int(time.time()),
+            (outputs[0] + 5) // 10 if n_out > 0 else 0,
+            (outputs[1] + 5) // 10 if n_out > 1 else 0,
+            (outputs[2] + 5) // 10 if n_out > 2 else 0,
+            encoder.adc_millivolts(0) if n_adc > 0 else 0,
+            encoder.adc_millivolts(1) if n_adc > 1 else 0,
+            encoder.adc_millivolts(2) if n_adc > 2 else 0,
+        )
+        self.count += 1
+        self.recorded += 1
+
+    def batch_json(self, max_events, now):
+        """
+        JSON replay batch of up to max_events oldest entries. They stay
+        queued until commit() is called, e.g. once the publish is acked.
+
+        Returns:
+            (payload, number of events)
+        """
+        core = self.core
+        n = min(max_events, self.count)
+        events = []
+        for k in range(n):
+            f = struct.unpack_from(ENTRY, self.buf, (self.head + k) % self.size * ENTRY_SIZE)
+            event = {
+                "type": "edge" if f[0] == KIND_EDGE else "status",
+                "time": f[8],
+                "age_ms": time.ticks_diff(now, f[7]),
+                "relays": [bool(f[3] >> i & 1) for i in range(core.num_relays)],
+                "inputs": [bool(f[4] >> i & 1) for i in range(core.num_inputs)],
+            }
+            if f[0] == KIND_EDGE:
+                event["input"] = f[1] + 1
+                event["state"] = "HIGH" if f[2] else "LOW"
+                event["count"] = f[5]
+                event["ticks_us"] = f[6]
+            else:
+                event["outputs"] = list(f[9:9 + min(3, core.num_outputs)])
+                event["adcs"] = [mv / 1000 for mv in f[12:12 + min(3, core.num_adcs)]]
+            events.append(event)
+
+        payload = json.dumps({
+            "events": events,
+            "remaining": self.count - n,
+            "dropped": self.unreported,
+        })
+        self.sent = n
+        self.reported = self.unreported
+        return payload, n
+
+    def commit(self):
+        """Remove the entries of the last batch from the front of the queue."""
+        n = self.sent
+        self.head = (self.head + n) % self.size
+        self.count -= n
+        self.replayed += n
+        self.unreported -= self.reported
+        self.sent = self.reported = 0
+
+    def stats(self):
+        return {
+            "queued": self.count,
+            "capacity": self.size,
+            "recorded": self.recorded,
+            "replayed": self.replayed,
+            "overflows": self.overflows,
+        }
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""
+Over-the-Air Firmware Update
+============================
+
+Pushes the firmware in this directory to one or more WiFi boards over
+the network (see ota.py). Only files whose SHA-256 differs from the copy
+on the board are transferred; the board pulls them from a temporary HTTP
+server started by this script, verifies them and restarts.
+
+The shared firmware core is sent as .mpy when mpy-cross is installed,
+like deploy-core.sh. config.py is never sent.
+
+The boards need OTA_KEY set in config.py (flashed once over USB); pass
+the same key with --key or the OTA_KEY environment variable.
+
+Usage:
+    ./ota-update.py 192.168.1.50 192.168.1.51 --key secret
+    ./ota-update.py 192.168.1.50 --dry-run
+"""
+
+import argparse
+import hashlib
+import hmac
+import http.server
+import json
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.error
+import urllib.request
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+CORE_DIR = os.path.join(SCRIPT_DIR, "..", "automation-firmware-core")
+CORE_MODULES = ("automation_core", "status_json")
+SKIP = ("config.py", "ota-update.py")
+
+
+def collect(build_dir):
+    """Firmware files to install, as {board path: local path}."""
+    files = {}
+    for name in sorted(os.listdir(SCRIPT_DIR)):
+        if name.endswith(".py") and name not in SKIP:
+            files[name] = os.path.join(SCRIPT_DIR, name)
+    for name in sorted(os.listdir(os.path.join(SCRIPT_DIR, "umqtt"))):
+        if name.endswith(".py"):
+            files["umqtt/" + name] = os.path.join(SCRIPT_DIR, "umqtt", name)
+
+    mpy_cross = shutil.which("mpy-cross")
+    for module in CORE_MODULES:
+        source = os.path.join(CORE_DIR, module + ".py")
+        if mpy_cross:
+            target = os.path.join(build_dir, module + ".mpy")
+            subprocess.run([mpy_cross, "-o", target, source], check=True)
+            files[module + ".mpy"] = target
+        else:
+            files[module + ".py"] = source
+    return files
+
+
+def sha256(path):
+    with open(path, "rb") as f:
+        return hashlib.sha256(f.read()).hexdigest()
+
+
+def local_address(board):
+    """Address of this host as seen from the board."""
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        s.connect((board, 80))
+        return s.getsockname()[0]
+
+
+def serve(files):
+    """Serve the firmware files on an ephemeral port; returns the server."""
+    by_path = {"/" + name: path for name, path in files.items()}
+
+    class Handler(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            path = by_path.get(self.path)
+            if path is None:
+                self.send_error(404)
+                return
+            with open(path, "rb") as f:
+                data = f.read()
+            self.send_response(200)
+            self.send_header("Content-Length", str(len(data)))
+            self.end_headers()
+            self.wfile.write(data)
+            self.server.sent += len(data)
+
+        def log_message(self, fmt, *args):
+            pass
+
+    server = http.server.ThreadingHTTPServer(("0.0.0.0", 0), Handler)
+    server.sent = 0
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
+
+
+def get_inventory(board, timeout=10):
+    with urllib.request.urlopen(f"http://{board}/api/ota", timeout=timeout) as resp:
+        return json.load(resp)
+
+
+def post_manifest(board, key, manifest):
+    body = json.dumps(manifest, separators=(",", ":")).encode()
+    signature = hmac.new(key.encode(), body, hashlib.sha256).hexdigest()
+    req = urllib.request.Request(
+        f"http://{board}/api/ota", data=body, method="POST",
+        headers={"Content-Type": "application/json", "X-Signature": signature})
+    try:
+        with urllib.request.urlopen(req, timeout=10) as resp:
+            return json.load(resp)
+    except urllib.error.HTTPError as e:
+        raise SystemExit(f"{board}: {e.code} {e.read().decode(errors='replace')}") from None
+
+
+def wait_for(board, serial, timeout):
+    """Wait until the board reports `serial` installed after restarting."""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        time.sleep(1)
+        try:
+            info = get_inventory(board, timeout=2)
+        except (OSError, ValueError):
+            continue  # Restarting
+        if info["serial"] == serial:
+            return info
+        if info["status"] == "failed":
+            raise SystemExit(f"{board}: update failed: {info['error']}")
+    raise SystemExit(f"{board}: no response after {timeout}s")
+
+
+def update(board, key, files, hashes, server, dry_run, timeout):
+    start = time.monotonic()
+    installed = get_inventory(board)["files"]
+    changed = {name: h for name, h in hashes.items() if installed.get(name) != h}
+    if not changed:
+        print(f"{board}: up to date")
+        return
+    size = sum(os.path.getsize(files[name]) for name in changed)
+    print(f"{board}: {len(changed)} changed file(s), {size} bytes: {', '.join(changed)}")
+    if dry_run:
+        return
+
+    serial = int(time.time())
+    port = server.server_address[1]
+    result = post_manifest(board, key, {
+        "serial": serial,
+        "base": f"http://{local_address(board)}:{port}/",
+        "files": changed,
+    })
+    print(f"{board}: accepted, downloading {len(result['files'])} file(s)")
+    wait_for(board, serial, timeout)
+    print(f"{board}: updated in {time.monotonic() - start:.1f}s")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Update WiFi boards over the air")
+    parser.add_argument("boards", nargs="+", help="Board IP addresses")
+    parser.add_argument("--key", default=os.environ.get("OTA_KEY"), help="Shared OTA_KEY")
+    parser.add_argument("--dry-run", action="store_true", help="Only list changed files")
+    parser.add_argument("--timeout", type=float, default=60, help="Seconds to wait per board")
+    args = parser.parse_args()
+    if not args.key and not args.dry_run:
+        parser.error("--key (or OTA_KEY) is required")
+
+    with tempfile.TemporaryDirectory() as build_dir:
+        files = collect(build_dir)
+        hashes = {name: sha256(path) for name, path in files.items()}
+        server = serve(files)
+        try:
+            for board in args.boards:
+                update(board, args.key, files, hashes, server, args.dry_run, args.timeout)
+        finally:
+            server.shutdown()
+        if server.sent:
+            print(f"Transferred {server.sent} bytes in total")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,359 @@
+"""
+Over-the-Air Updates for Automation 2040 W
+==========================================
+
+Incremental firmware updates over HTTP, driven by ota-update.py on a
+host:
+
+1. GET /api/ota lists the SHA-256 of every installed .py/.mpy file
+2. The host POSTs a manifest of the files that differ, signed with
+   HMAC-SHA256 using the shared OTA_KEY (X-Signature header)
+3. The board downloads each file from the manifest's base URL, streaming
+   it into a staging directory while hashing it, so only the changed
+   bytes move and no file is ever held in RAM
+4. When every file has verified, a journal is written and the staged
+   files are renamed over the installed ones, then the board resets
+
+The journal makes the swap all-or-nothing: if power is lost part way
+through, resume() (called first thing in main.py) finishes the renames
+at the next boot. Each manifest carries a serial number that must be
+higher than the last installed one, so a captured manifest cannot be
+replayed. The state is written twice (ota.json, then ota.bak); if
+neither copy can be read, updates are refused rather than restarting
+the serial at 0. config.py is never touched.
+
+Manifest (JSON):
+    {"serial": 1718000000, "base": "http://192.168.1.10:8266/",
+     "files": {"main.py": "<sha256 hex>", "umqtt/simple.py": "<sha256 hex>"}}
+"""
+
+import binascii
+import hashlib
+import json
+import os
+import socket
+
+STAGING = "ota"  # Directory downloads are staged in
+STATE = "ota.json"  # Last installed serial, and the swap journal while swapping
+BACKUP = "ota.bak"  # Copy of STATE, written after it
+DIRS = ("", "umqtt")  # Directories holding firmware files
+PROTECTED = ("config.py",)
+
+
+class OtaError(Exception):
+    """Rejected manifest or failed update."""
+
+
+def hmac_sha256(key, msg):
+    """HMAC-SHA256 (RFC 2104); MicroPython has no hmac module."""
+    if len(key) > 64:
+        key = hashlib.sha256(key).digest()
+    key = key + bytes(64 - len(key))
+    inner = hashlib.sha256(bytes(b ^ 0x36 for b in key))
+    inner.update(msg)
+    outer = hashlib.sha256(bytes(b ^ 0x5C for b in key))
+    outer.update(inner.digest())
+    return outer.digest()
+
+
+def _exists(path):
+    try:
+        os.stat(path)
+        return True
+    except OSError:
+        return False
+
+
+def _makedirs(path):
+    """Create each directory along path (os.makedirs is not available)."""
+    parts = path.split("/")
+    for i in range(1, len(parts) + 1):
+        part = "/".join(parts[:i])
+        if not _exists(part):
+            os.mkdir(part)
+
+
+def _remove_tree(path):
+    if not _exists(path):
+        return
+    for name in os.listdir(path):
+        child = path + "/" + name
+        if os.stat(child)[0] & 0x4000:  # Directory
+            _remove_tree(child)
+        else:
+            os.remove(child)
+    os.rmdir(path)
+
+
+def valid_name(name):
+    """Only firmware files in known directories, never config.py."""
+    if name in PROTECTED or ".." in name or name.startswith("/"):
+        return False
+    if not (name.endswith(".py") or name.endswith(".mpy")):
+        return False
+    slash = name.rfind("/")
+    return (name[:slash] if slash >= 0 else "") in DIRS
+
+
+def _valid_sha(sha):
+    """A SHA-256 as 64 hex digits, either case."""
+    if not isinstance(sha, str) or len(sha) != 64:
+        return False
+    try:
+        binascii.unhexlify(sha)
+    except ValueError:
+        return False
+    return True
+
+
+def _counterpart(name):
+    """The .py for a .mpy and vice versa; a leftover .py would shadow the .mpy."""
+    if name.endswith(".mpy"):
+        return name[:-4] + ".py"
+    return name[:-3] + ".mpy"
+
+
+def _read_state(path):
+    """The state in path, or None if it is unreadable or not a valid state."""
+    try:
+        with open(path) as f:
+            state = json.load(f)
+    except (OSError, ValueError):
+        return None
+    if not isinstance(state, dict) or type(state.get("serial")) is not int:
+        return None
+    swap = state.get("swap", [])
+    if not isinstance(swap, list) or not all(isinstance(n, str) and valid_name(n) for n in swap):
+        return None
+    return state
+
+
+def _load_state():
+    """
+    Returns:
+        The saved state, {"serial": 0} before the first update, or None
+        if a state file exists but neither copy is valid
+    """
+    state = _read_state(STATE) or _read_state(BACKUP)
+    if state is None and not _exists(STATE) and not _exists(BACKUP):
+        return {"serial": 0}
+    return state
+
+
+def _save_state(state):
+    for path in (STATE, BACKUP):
+        with open(path, "w") as f:
+            json.dump(state, f)
+
+
+def _swap(state):
+    """Rename the journalled staged files into place, then clear the journal."""
+    for name in state["swap"]:
+        staged = STAGING + "/" + name
+        if _exists(staged):  # Already renamed if the last attempt got past it
+            if _exists(name):
+                os.remove(name)
+            os.rename(staged, name)
+        other = _counterpart(name)
+        if _exists(other):
+            os.remove(other)
+    del state["swap"]
+    _save_state(state)
+    _remove_tree(STAGING)
+
+
+def resume():
+    """Finish a swap interrupted by a reset. Call before importing firmware modules."""
+    state = _load_state()
+    if state is None:
+        print(f"OTA: {STATE} is corrupt, updates disabled")
+    elif "swap" in state:
+        print("OTA: completing interrupted update")
+        _swap(state)
+
+
+class Updater:
+    """Verifies manifests and installs the files they list."""
+
+    def __init__(self, key, buf_size=1024):
+        """
+        Args:
+            key: Shared secret the manifests are signed with
+            buf_size: Download buffer size
+        """
+        self.key = key.encode()
+        self.buf = bytearray(buf_size)
+        self.view = memoryview(self.buf)
+        state = _load_state()
+        self.serial = state["serial"] if state else None  # None: corrupt, refuse updates
+        self.pending = None  # (serial, base URL, [(name, sha256)]) to install
+        self.status = "idle"
+        self.error = None
+        self.downloaded = 0  # Bytes fetched by the last update
+
+    def file_hash(self, path):
+        """Hex SHA-256 of a file, or None if it does not exist."""
+        h = hashlib.sha256()
+        try:
+            with open(path, "rb") as f:
+                while True:
+                    n = f.readinto(self.buf)
+                    if not n:
+                        break
+                    h.update(self.view[:n])
+        except OSError:
+            return None
+        return binascii.hexlify(h.digest()).decode()
+
+    def inventory(self):
+        """Installed firmware files and their hashes, for GET /api/ota."""
+        files = {}
+        for d in DIRS:
+            try:
+                names = os.listdir(d) if d else os.listdir()
+            except OSError:
+                continue
+            for name in names:
+                path = d + "/" + name if d else name
+                if valid_name(path):
+                    files[path] = self.file_hash(path)
+        return {
+            "serial": self.serial,
+            "status": self.status,
+            "error": self.error,
+            "downloaded": self.downloaded,
+            "files": files,
+        }
+
+    def accept(self, body, signature):
+        """
+        Check a manifest and queue the files that differ for download.
+
+        Returns:
+            dict describing the accepted update
+
+        Raises:
+            OtaError: Bad signature, replayed serial or invalid manifest
+        """
+        if self.serial is None:
+            raise OtaError(f"{STATE} and {BACKUP} are corrupt; updates disabled")
+        if self.pending:
+            raise OtaError("Update already in progress")
+        try:
+            expected = binascii.unhexlify(signature or "")
+        except ValueError:
+            expected = b""
+        actual = hmac_sha256(self.key, body)
+        diff = len(expected) ^ len(actual)
+        for a, b in zip(actual, expected):
+            diff |= a ^ b
+        if diff:
+            raise OtaError("Bad signature")
+
+        try:
+            manifest = json.loads(bytes(body))
+        except ValueError:
+            raise OtaError("Bad manifest") from None
+        if not isinstance(manifest, dict):
+            raise OtaError("Bad manifest")
+        serial = manifest.get("serial")
+        base = manifest.get("base")
+        files = manifest.get("files")
+        if type(serial) is not int:  # Not bool, float or a numeric string
+            raise OtaError("Manifest serial must be an integer")
+        if not isinstance(base, str) or not isinstance(files, dict):
+            raise OtaError("Manifest needs base (string) and files (object)")
+        if serial <= self.serial:
+            raise OtaError(f"Serial {serial} is not newer than {self.serial}")
+        if not base.startswith("http://"):
+            raise OtaError("Base URL must be http://")
+
+        changed = []
+        for name, sha in files.items():
+            if not valid_name(name):
+                raise OtaError("Refusing to write " + name)
+            if not _valid_sha(sha):
+                raise OtaError("Bad SHA-256 for " + name)
+            sha = sha.lower()
+            if self.file_hash(name) != sha:
+                changed.append((name, sha))
+
+        if changed:
+            self.pending = (serial, base, changed)
+            self.status = "pending"
+        else:
+            self._finish(serial)  # Nothing to move, just record the serial
+        self.error = None
+        return {"status": "accepted", "serial": serial, "files": [n for n, _ in changed]}
+
+    def run(self):
+        """
+        Download, verify and install the pending update.
+
+        Returns:
+            True if files were installed and the board should reset
+        """
+        serial, base, changed = self.pending
+        self.pending = None
+        self.status = "downloading"
+        self.downloaded = 0
+        try:
+            _remove_tree(STAGING)
+            for name, sha in changed:
+                staged = STAGING + "/" + name
+                _makedirs(staged[:staged.rfind("/")])
+                got = self._fetch(base + name, staged)
+                if got != sha:
+                    raise OtaError("Hash mismatch for " + name)
+
+            # Everything verified: journal, then swap
+            self.status = "installing"
+            state = {"serial": serial, "swap": [name for name, _ in changed]}
+            _save_state(state)
+            _swap(state)
+            self._finish(serial)
+            return True
+        except Exception as e:
+            self.status = "failed"
+            self.error = str(e)
+            print(f"OTA failed: {e}")
+            try:
+                _remove_tree(STAGING)
+            except OSError:
+                pass
+            return False
+
+    def _finish(self, serial):
+        self.serial = serial
+        self.status = "installed"
+        _save_state({"serial": serial})
+
+    def _fetch(self, url, path):
+        """Stream url into path. Returns the hex SHA-256 of the body."""
+        host, _, target = url[7:].partition("/")
+        host, _, port = host.partition(":")
+        s = socket.socket()
+        try:
+            s.settimeout(5)
+            s.connect(socket.getaddrinfo(host, int(port or 80))[0][-1])
+            s.sendall(f"GET /{target} HTTP/1.0\r\nHost: {host}\r\n\r\n".encode())
+            stream = s.makefile("rb")
+            status = stream.readline()
+            if b" 200 " not in status:
+                raise OtaError(f"GET {target}: {status.decode().strip()}")
+            while stream.readline() not in (b"\r\n", b"\n", b""):
+                pass  # Headers; the body runs to connection close
+
+            h = hashlib.sha256()
+            with open(path, "wb") as f:
+                while True:
+                    n = stream.readinto(self.buf)
+                    if not n:
+                        break
+                    chunk = self.view[:n]
+                    h.update(chunk)
+                    f.write(chunk)
+                    self.downloaded += n
+            return binascii.hexlify(h.digest()).decode()
+        finally:
+            s.close()
@@ -0,0 +1,152 @@
+"""
+Power Management for Automation 2040 W
+======================================
+
+Decides how the main loop sleeps between passes, and accounts the time
+spent in each power state:
+
+- active:     running the main loop
+- idle:       CPU halted in machine.idle()/time.sleep_ms(), woken by any
+              interrupt, WiFi chip still servicing the network
+- lightsleep: machine.lightsleep(), clocks stopped until the timer or a
+              GPIO interrupt (LOW_POWER_LIGHTSLEEP only)
+
+In normal mode the loop sleeps 10 ms per pass, as before. In low-power
+mode (LOW_POWER = True):
+
+- The loop sleeps until the next scheduled job (status publish, input
+  resync), but never longer than LOW_POWER_LATENCY_MS. That bounds how
+  long HTTP, TCP and MQTT traffic waits to be served.
+- An input edge ends the sleep immediately. The pin IRQs stay armed, and
+  the edge callback calls wake().
+- After any activity (HTTP request, TCP client, MQTT command, input) the
+  loop stays at the 10 ms period for LOW_POWER_HOLD_MS, so interactive
+  use does not feel slow.
+- WiFi is put into its power-save mode whenever it connects. The radio
+  then sleeps between beacons, which saves most of the power.
+"""
+
+import time
+from array import array
+
+import machine
+
+ACTIVE = 0
+IDLE = 1
+LIGHTSLEEP = 2
+STATE_NAMES = ("active", "idle", "lightsleep")
+
+# cyw43 power management values (network.WLAN.PM_* on newer firmware)
+PM_PERFORMANCE = 0xA11140
+PM_POWERSAVE = 0xA11142
+
+
+class PowerManager:
+    """Main loop sleep policy and power state accounting."""
+
+    def __init__(self, wlan, low_power=False, latency_ms=100, hold_ms=2000,
+                 lightsleep=False, wifi_power_save=True, loop_ms=10):
+        """
+        Args:
+            wlan: Station interface, for the WiFi power-save mode
+            low_power: Sleep until the next job instead of every loop_ms
+            latency_ms: Longest sleep in low-power mode
+            hold_ms: Time to keep the normal loop period after activity
+            lightsleep: Use machine.lightsleep() instead of idling
+            wifi_power_save: Enable WiFi power save in low-power mode
+            loop_ms: Loop period in normal mode and while holding
+        """
+        self.wlan = wlan
+        self.low_power = low_power
+        self.latency_ms = latency_ms
+        self.hold_ms = hold_ms
+        self.lightsleep = lightsleep
+        self.wifi_power_save = low_power and wifi_power_save
+        self.loop_ms = loop_ms
+
+        self.woken = False  # Set by wake() while sleeping
+        self.hold_until = time.ticks_ms()
+        self.wifi_up = False
+
+        # Time per state: whole ms, plus the sub-ms remainder in us
+        self.ms = array("I", [0] * len(STATE_NAMES))
+        self.us = array("I", [0] * len(STATE_NAMES))
+        self.wakes_input = 0
+        self.wakes_timer = 0
+        self.last_wake = time.ticks_us()
+
+    def _account(self, state, us):
+        us += self.us[state]
+        self.ms[state] += us // 1000
+        self.us[state] = us % 1000
+
+    def wake(self):
+        """End the current sleep early (input edge). Safe from scheduled callbacks."""
+        self.woken = True
+        self.activity()
+
+    def activity(self):
+        """Keep the normal loop period for hold_ms."""
+        self.hold_until = time.ticks_add(time.ticks_ms(), self.hold_ms)
+
+    def poll_wifi(self, connected):
+        """Apply the WiFi power mode each time the link comes up."""
+        if connected and not self.wifi_up and self.wifi_power_save:
+            try:
+                self.wlan.config(pm=PM_POWERSAVE)
+                print("WiFi power save enabled")
+            except Exception as e:
+                print(f"WiFi power save not available: {e}")
+                self.wifi_power_save = False
+        self.wifi_up = connected
+
+    def sleep(self, now, due):
+        """
+        Sleep between main loop passes.
+
+        Args:
+            now: time.ticks_ms() at the start of the pass
+            due: time.ticks_ms() when the next scheduled job is due
+        """
+        start = time.ticks_us()
+        self._account(ACTIVE, time.ticks_diff(start, self.last_wake))
+
+        if not self.low_power or time.ticks_diff(self.hold_until, now) > 0:
+            time.sleep_ms(self.loop_ms)
+            state = IDLE
+        else:
+            ms = min(max(time.ticks_diff(due, now), self.loop_ms), self.latency_ms)
+            self.woken = False
+            if self.lightsleep:
+                machine.lightsleep(ms)
+                state = LIGHTSLEEP
+            else:
+                deadline = time.ticks_add(now, ms)
+                while not self.woken and time.ticks_diff(deadline, time.ticks_ms()) > 0:
+                    machine.idle()  # Returns after the next interrupt
+                state = IDLE
+            if self.woken:
+                self.wakes_input += 1
+            else:
+                self.wakes_timer += 1
+
+        self.last_wake = time.ticks_us()
+        self._account(state, time.ticks_diff(self.last_wake, start))
+
+    def stats(self):
+        total = 0
+        for ms in self.ms:
+            total += ms
+        time_ms = {}
+        percent = {}
+        for i, name in enumerate(STATE_NAMES):
+            time_ms[name] = self.ms[i]
+            percent[name] = round(self.ms[i] * 100 / total, 1) if total else 0
+        return {
+            "mode": "low" if self.low_power else "normal",
+            "wifi_power_save": self.wifi_power_save,
+            "latency_ms": self.latency_ms if self.low_power else self.loop_ms,
+            "time_ms": time_ms,
+            "percent": percent,
+            "wakes": {"input": self.wakes_input, "timer": self.wakes_timer},
+        }
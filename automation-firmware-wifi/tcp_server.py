@@ -0,0 +1,109 @@
+"""
+Raw TCP Text-Protocol Server for Automation 2040 W
+==================================================
+
+Speaks the same newline-terminated command protocol as the USB serial
+firmware (RELAY/OUTPUT/INPUT/ADC/LED/BUTTON/STATUS/RESET/VERSION/PING),
+so the host library can drive a WiFi board over the LAN with
+Automation2040W("socket://<board-ip>:2040").
+
+Clients may pipeline: every complete line in the receive buffer is
+executed in order and all responses go out in a single write.
+"""
+
+import errno
+import socket
+
+MAX_LINE = 256  # Longest accepted command line in bytes
+
+
+class TextServer:
+    """Non-blocking line-protocol server, polled from the main loop."""
+
+    def __init__(self, core, port=2040, max_clients=2):
+        """
+        Args:
+            core: AutomationCore that executes the commands
+            port: TCP port to listen on
+            max_clients: Further connections are closed immediately
+        """
+        self.core = core
+        self.max_clients = max_clients
+        self.clients = []  # [socket, receive buffer] pairs
+
+        addr = socket.getaddrinfo('0.0.0.0', port)[0][-1]
+        self.sock = socket.socket()
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.bind(addr)
+        self.sock.listen(1)
+        self.sock.setblocking(False)
+        print(f"TCP command server on port {port}")
+
+    def poll(self):
+        """Accept new clients and serve every complete command line."""
+        try:
+            cl, addr = self.sock.accept()
+            if len(self.clients) >= self.max_clients:
+                cl.close()
+            else:
+                cl.setblocking(False)
+                self.clients.append([cl, b""])
+                print(f"TCP: client {addr[0]} connected")
+        except OSError:
+            pass  # No connection waiting
+
+        for client in self.clients[:]:
+            try:
+                self._serve(client)
+            except OSError:
+                self._close(client)
+
+    def _serve(self, client):
+        cl = client[0]
+        try:
+            data = cl.recv(512)
+        except OSError as e:
+            if e.args[0] == errno.EAGAIN:
+                return  # Nothing received
+            raise
+        if not data:
+            self._close(client)
+            return
+        buf = client[1] + data
+
+        out = []
+        start = 0
+        while True:
+            end = buf.find(b"\n", start)
+            if end < 0:
+                break
+            line = buf[start:end]
+            start = end + 1
+            try:
+                line = line.decode()
+            except UnicodeError:
+                out.append("ERR Invalid UTF-8")  # Dropped, the client stays connected
+                continue
+            response = self.core.execute(line)
+            if response is not None:
+                out.append(response)
+        buf = buf[start:]
+        if len(buf) > MAX_LINE:
+            out.append("ERR Line too long")
+            buf = b""
+        client[1] = buf
+
+        if out:
+            out.append("")
+            # A client that stops reading times out and is dropped by poll()
+            cl.settimeout(2.0)
+            cl.sendall("\n".join(out).encode())
+            cl.setblocking(False)
+
+    def _close(self, client):
+        try:
+            client[0].close()
+        except OSError:
+            pass
+        self.clients.remove(client)
+
@@ -0,0 +1,106 @@
+"""
+UDP Telemetry for Automation 2040 W
+===================================
+
+Sends a compact binary status frame to a multicast group (or the
+broadcast address) at a fixed rate. One frame is a single UDP datagram
+of ~30 bytes, assembled in a preallocated buffer, so even a fast rate
+costs far less than an MQTT publish or an HTTP poll.
+
+Frame layout (big-endian), decoded by automation-gateway/lib/telemetry.py:
+
+    offset  size  field
+    0       2     magic b"A2"
+    2       1     frame version (1)
+    3       1     flags: bit0 WiFi up, bit1 MQTT up
+    4       6     board id (WiFi MAC address)
+    10      4     sequence number (wraps at 2^30)
+    14      4     uptime in ms (time.ticks_ms, wraps)
+    18      1     relay count << 4 | output count
+    19      1     input count << 4 | ADC count
+    20      1     relay bitmask (bit0 = relay 1)
+    21      1     input bitmask (bit0 = input 1)
+    22      n     outputs, one byte each, percent 0-100
+    22+n    2*m   ADCs, unsigned 16-bit millivolts each
+"""
+
+import socket
+import struct
+import time
+
+MAGIC = b"A2"
+FRAME_VERSION = 1
+HEADER = "!2sBB6sIIBBBB"
+HEADER_SIZE = struct.calcsize(HEADER)
+
+
+class Telemetry:
+    """Periodic UDP status sender, polled from the main loop."""
+
+    def __init__(self, core, board_id, addr="239.20.40.1", port=20400, interval_ms=200):
+        """
+        Args:
+            core: AutomationCore to sample
+            board_id: 6-byte board identifier (WiFi MAC)
+            addr: Multicast group or broadcast address
+            port: Destination UDP port
+            interval_ms: Time between frames
+        """
+        self.core = core
+        self.board_id = bytes(board_id[:6])
+        self.interval_ms = interval_ms
+        self.seq = 0
+        self.sent = 0
+        self.errors = 0
+        self.last_send = 0
+
+        self.dest = socket.getaddrinfo(addr, port)[0][-1]
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        if hasattr(socket, "SO_BROADCAST"):
+            self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+        self.sock.setblocking(False)
+
+        self.frame = bytearray(HEADER_SIZE + core.num_outputs + 2 * core.num_adcs)
+        self.counts = (core.num_relays << 4 | core.num_outputs, core.num_inputs << 4 | core.num_adcs)
+        print(f"UDP telemetry to {addr}:{port} every {interval_ms} ms")
+
+    def poll(self, now, wifi_up, mqtt_up):
+        """Send a frame if the interval elapsed and the network is up."""
+        if not wifi_up or time.ticks_diff(now, self.last_send) < self.interval_ms:
+            return
+        self.last_send = now
+        self.send(now, wifi_up, mqtt_up)
+
+    def send(self, now, wifi_up=True, mqtt_up=False):
+        core = self.core
+        frame = self.frame
+
+        relays = 0
+        for i in range(core.num_relays):
+            if core.relay(i):
+                relays |= 1 << i
+        inputs = 0
+        for i in range(core.num_inputs):
+            if core.read_input(i):
+                inputs |= 1 << i
+
+        struct.pack_into(
+            HEADER, frame, 0,
+            MAGIC, FRAME_VERSION, wifi_up | mqtt_up << 1, self.board_id,
+            self.seq, now & 0xFFFFFFFF, self.counts[0], self.counts[1], relays, inputs,
+        )
+        pos = HEADER_SIZE
+        for i in range(core.num_outputs):
+            frame[pos] = int(core.output(i) * 100 + 0.5)
+            pos += 1
+        for i in range(core.num_adcs):
+            mv = int(core.read_adc(i) * 1000 + 0.5)
+            struct.pack_into("!H", frame, pos, max(0, min(0xFFFF, mv)))
+            pos += 2
+
+        try:
+            self.sock.sendto(frame, self.dest)
+            self.sent += 1
+        except OSError:
+            self.errors += 1  # Dropped by the stack (e.g. buffers full), not retried
+        self.seq = (self.seq + 1) & 0x3FFFFFFF  # Stays a small int
@@ -4,16 +4,96 @@ umqtt.simple - Simple MQTT client for MicroPython
 
 This is a minimal MQTT client from micropython-lib.
 https://github.com/micropython/micropython-lib/tree/master/micropython/umqtt.simple
+
+Speaks MQTT 3.1.1 by default; version=5 selects MQTT 5, which adds topic
+aliases for publishing and session expiry.
 """
 
+from array import array
+
+import uerrno as errno
+import uselect as select
 import usocket as socket
 import ustruct as struct
+import utime as time
+
+# MQTT 5 property value sizes by identifier (the rest are strings/binary)
+_PROP_BYTE = b"\x01\x17\x19\x24\x25\x28\x29\x2a"
+_PROP_SHORT = b"\x13\x21\x22\x23"
+_PROP_INT = b"\x02\x11\x18\x27"
+
+# In-flight publish states
+_AWAIT_PUBACK = 1  # QoS 1
+_AWAIT_PUBREC = 2  # QoS 2, PUBLISH sent
+_AWAIT_PUBCOMP = 3  # QoS 2, PUBREL sent
 
 
 class MQTTException(Exception):
     pass
 
 
+def _buffer(s):
+    # Bytes view of s without copying (MicroPython str has the buffer
+    # protocol; CPython str, in the bench harness, is encoded)
+    try:
+        return memoryview(s)
+    except TypeError:
+        return s.encode()
+
+
+def _put_len(buf, i, sz):
+    # Remaining Length (variable byte integer) at buf[i]; returns the end
+    while sz > 0x7F:
+        buf[i] = (sz & 0x7F) | 0x80
+        sz >>= 7
+        i += 1
+    buf[i] = sz
+    return i + 1
+
+
+def _get_len(buf, i):
+    # Variable byte integer at buf[i]; returns (value, end)
+    n = sh = 0
+    while 1:
+        b = buf[i]
+        n |= (b & 0x7F) << sh
+        i += 1
+        if not b & 0x80:
+            return n, i
+        sh += 7
+
+
+def _skip_props(buf, i):
+    # End of the MQTT 5 property block (length and properties) at buf[i]
+    n, i = _get_len(buf, i)
+    return i + n
+
+
+def _prop_size(buf, i, p):
+    # Size of the value of property p, which starts at buf[i]
+    if p in _PROP_BYTE:
+        return 1
+    if p in _PROP_SHORT:
+        return 2
+    if p in _PROP_INT:
+        return 4
+    if p == 0x0B:  # Subscription Identifier, variable byte integer
+        return _get_len(buf, i)[1] - i
+    n = 2 + (buf[i] << 8 | buf[i + 1])
+    if p == 0x26:  # User Property, string pair
+        n += 2 + (buf[i + n] << 8 | buf[i + n + 1])
+    return n
+
+
+def _put_str(buf, i, s):
+    # 2-byte length prefixed string/bytes at buf[i]; returns the end
+    n = len(s)
+    buf[i] = n >> 8
+    buf[i + 1] = n & 0xFF
+    buf[i + 2 : i + 2 + n] = s
+    return i + 2 + n
+
+
 class MQTTClient:
     def __init__(
         self,
@@ -25,6 +105,16 @@ class MQTTClient:
         keepalive=0,
         ssl=False,
         ssl_params={},
+        buf_size=256,
+        rbuf_size=512,
+        max_packet=4096,
+        window=4,
+        retry_ms=5000,
+        rx_window=8,
+        ping_timeout_ms=5000,
+        version=4,
+        session_expiry=0,
+        topic_aliases=8,
     ):
         if port == 0:
             port = 8883 if ssl else 1883
@@ -43,24 +133,108 @@ class MQTTClient:
         self.lw_msg = None
         self.lw_qos = 0
         self.lw_retain = False
+        self._poller = None
+        self._connect_sent = False
+        self._session_present = None  # CONNACK flag, None until it arrives
+        # Protocol level, 4 (3.1.1) or 5. session_expiry (seconds) asks the
+        # broker to keep the session after a disconnect, and turns off
+        # clean_session by default so it is resumed on reconnect (3.1.1
+        # brokers keep it as long as they are configured to).
+        self.version = version
+        self.session_expiry = session_expiry
+        # MQTT 5 topic aliases: the first publish to a topic also assigns
+        # it an alias, later ones send the 2-byte alias instead of the
+        # topic. Up to topic_aliases topics (limited by the broker's
+        # maximum), assigned first come first served for the connection.
+        self.topic_aliases = topic_aliases
+        self.alias_max = 0
+        self._aliases = []
+        # Outgoing packets are assembled here and sent with a single write,
+        # so each packet leaves as one TCP segment where it fits
+        self._buf = bytearray(buf_size)
+        self._view = memoryview(self._buf)
+        # Incoming bytes are parsed from here as they arrive (see check_msg)
+        self._rbuf = bytearray(rbuf_size)
+        self._rview = memoryview(self._rbuf)
+        self._rpos = 0  # Start of the first unparsed packet
+        self._rlen = 0  # End of the received bytes
+        self._skip = 0  # Bytes still to discard of an oversized packet
+        self.max_packet = max_packet
+        self.dropped = 0  # Incoming packets discarded for exceeding max_packet
+        self._ack_pid = 0  # Last PUBACK / SUBACK packet ids, for the blocking calls
+        self._suback_pid = 0
+        # QoS 1/2 publishes awaiting their acks (publish_nowait): packet id
+        # (0 = free slot), state, last send time and the packet, kept for
+        # resending until the broker has acknowledged receipt. The table
+        # outlives the connection: reconnect with the same client and the
+        # packets are resent after CONNACK (see _resume). The topic is kept
+        # when aliases are in use, as they do not carry over.
+        self.window = window
+        self.retry_ms = retry_ms
+        self._flight_pid = array("H", [0] * window)
+        self._flight_state = bytearray(window)
+        self._flight_time = array("i", [0] * window)
+        self._flight_pkt = [None] * window
+        self._flight_topic = [None] * window
+        # Ids of incoming QoS 2 messages delivered but not yet released by
+        # PUBREL, so a resent PUBLISH is not delivered twice. Fixed size; the
+        # oldest entry is overwritten if the broker has more outstanding.
+        self._rx_pids = array("H", [0] * rx_window)
+        self._rx_next = 0
+        # Keepalive: with keepalive > 0, check_msg() sends PINGREQ once
+        # nothing has been sent or received for half the interval, and
+        # raises if the PINGRESP is not back within ping_timeout_ms
+        self.ping_timeout_ms = ping_timeout_ms
+        self._last_tx = 0
+        self._last_rx = 0
+        self._ping_sent = None  # ticks_ms of the outstanding PINGREQ
+        self.pings = 0
+        self.ping_rtt_ms = -1
+        self.inflight = 0
+        self.acked = 0
+        self.retransmits = 0
+        self.ack_cb = None
 
-    def _send_str(self, s):
-        self.sock.write(struct.pack("!H", len(s)))
-        self.sock.write(s)
+    def _packet(self, size):
+        # Send buffer with room for size bytes, grown if needed
+        if size > len(self._buf):
+            self._buf = bytearray(size)
+            self._view = memoryview(self._buf)
+        return self._buf
 
-    def _recv_len(self):
-        n = 0
-        sh = 0
+    def _send(self, n):
+        self.sock.write(self._view[:n])
+        self._last_tx = time.ticks_ms()
+
+    def _send_ack(self, op, pid):
+        # PUBACK / PUBREC / PUBREL / PUBCOMP
+        buf = self._packet(4)
+        buf[0] = op
+        buf[1] = 2
+        struct.pack_into("!H", buf, 2, pid)
+        self._send(4)
+
+    def _slot(self, pid):
+        # In-flight table index of pid (0 finds a free slot), or -1
+        for i in range(self.window):
+            if self._flight_pid[i] == pid:
+                return i
+        return -1
+
+    def _next_pid(self):
+        # Packet ids wrap at 65535 and skip ids still in flight
         while 1:
-            b = self.sock.read(1)[0]
-            n |= (b & 0x7F) << sh
-            if not b & 0x80:
-                return n
-            sh += 7
+            self.pid = self.pid % 65535 + 1
+            if self._slot(self.pid) < 0:
+                return self.pid
 
     def set_callback(self, f):
         self.cb = f
 
+    def set_ack_callback(self, f):
+        # f(pid) runs from check_msg() when a publish_nowait() is acked
+        self.ack_cb = f
+
     def set_last_will(self, topic, msg, retain=False, qos=0):
         assert 0 <= qos <= 2
         assert topic
@@ -69,7 +243,15 @@ class MQTTClient:
         self.lw_qos = qos
         self.lw_retain = retain
 
-    def connect(self, clean_session=True):
+    def _reset(self):
+        # Per-connection state
+        self._rpos = self._rlen = self._skip = 0
+        self._session_present = None
+        self.alias_max = 0
+        self._aliases = []
+
+    def connect(self, clean_session=None):
+        self._reset()
         self.sock = socket.socket()
         addr = socket.getaddrinfo(self.server, self.port)[0][-1]
         self.sock.connect(addr)
@@ -77,44 +259,128 @@ class MQTTClient:
             import ussl
 
             self.sock = ussl.wrap_socket(self.sock, **self.ssl_params)
-        premsg = bytearray(b"\x10\0\0\0\0\0")
-        msg = bytearray(b"\x04MQTT\x04\x02\0\0")
+        self._send_connect(clean_session)
+        op = self.sock.read(1)[0]
+        sz = sh = 0
+        while 1:
+            b = self.sock.read(1)[0]
+            sz |= (b & 0x7F) << sh
+            if not b & 0x80:
+                break
+            sh += 7
+        assert op == 0x20
+        self._handle(op, memoryview(self.sock.read(sz)))
+        self._resume()
+        return self._session_present
+
+    def begin_connect(self, clean_session=None):
+        # Non-blocking variant of connect(): starts the TCP handshake and
+        # returns immediately. Call poll_connect() until it returns the
+        # session-present flag. Name resolution still blocks, so use an IP
+        # address for the broker where that matters. Not supported with SSL.
+        assert not self.ssl
+        self._reset()
+        addr = socket.getaddrinfo(self.server, self.port)[0][-1]
+        self.sock = socket.socket()
+        self.sock.setblocking(False)
+        try:
+            self.sock.connect(addr)
+        except OSError as e:
+            if e.args[0] != errno.EINPROGRESS:
+                raise
+        self._poller = select.poll()
+        self._poller.register(self.sock, select.POLLOUT | select.POLLIN)
+        self._clean_session = clean_session
+        self._connect_sent = False
 
-        sz = 10 + 2 + len(self.client_id)
-        msg[6] = clean_session << 1
+    def poll_connect(self):
+        # Returns None while the connection is in progress, the CONNACK
+        # session-present flag once connected, and raises on failure.
+        for _, ev in self._poller.ipoll(0):
+            if ev & (select.POLLERR | select.POLLHUP):
+                raise OSError(errno.ECONNREFUSED)
+            if not self._connect_sent and ev & select.POLLOUT:
+                self._send_connect(self._clean_session)
+                self._connect_sent = True
+                self._poller.modify(self.sock, select.POLLIN)
+            elif self._connect_sent and ev & select.POLLIN:
+                # CONNACK goes through the receive parser; it may arrive in
+                # pieces (MQTT 5 CONNACK carries properties)
+                if self._next_packet(False) == 0x20:
+                    self._poller = None
+                    self.sock.setblocking(True)
+                    self._resume()
+                    return self._session_present
+        return None
+
+    def _send_connect(self, clean_session):
+        if clean_session is None:
+            clean_session = not self.session_expiry
+        client_id = _buffer(self.client_id)
+        flags = clean_session << 1
+        props = 0
+        if self.version == 5:
+            props = 6 if self.session_expiry else 1
+        sz = 10 + props + 2 + len(client_id)
         if self.user is not None:
-            sz += 2 + len(self.user) + 2 + len(self.pswd)
-            msg[6] |= 0xC0
-        if self.keepalive:
-            assert self.keepalive < 65536
-            msg[7] |= self.keepalive >> 8
-            msg[8] |= self.keepalive & 0x00FF
+            user = _buffer(self.user)
+            pswd = _buffer(self.pswd)
+            sz += 2 + len(user) + 2 + len(pswd)
+            flags |= 0xC0
+        assert self.keepalive < 65536
         if self.lw_topic:
-            sz += 2 + len(self.lw_topic) + 2 + len(self.lw_msg)
-            msg[6] |= 0x4 | (self.lw_qos & 0x1) << 3 | (self.lw_qos & 0x2) << 3
-            msg[6] |= self.lw_retain << 5
-
-        i = 1
-        while sz > 0x7F:
-            premsg[i] = (sz & 0x7F) | 0x80
-            sz >>= 7
-            i += 1
-        premsg[i] = sz
+            lw_topic = _buffer(self.lw_topic)
+            lw_msg = _buffer(self.lw_msg)
+            sz += 2 + len(lw_topic) + 2 + len(lw_msg)
+            if props:
+                sz += 1  # Empty will properties
+            flags |= 0x4 | (self.lw_qos & 0x1) << 3 | (self.lw_qos & 0x2) << 3
+            flags |= self.lw_retain << 5
 
-        self.sock.write(premsg[: i + 2])
-        self.sock.write(msg)
-        self._send_str(self.client_id)
+        buf = self._packet(sz + 5)
+        buf[0] = 0x10
+        i = _put_len(buf, 1, sz)
+        buf[i : i + 6] = b"\x00\x04MQTT"
+        buf[i + 6] = self.version
+        buf[i + 7] = flags
+        buf[i + 8] = self.keepalive >> 8
+        buf[i + 9] = self.keepalive & 0xFF
+        i += 10
+        if props:
+            buf[i] = props - 1
+            if self.session_expiry:
+                buf[i + 1] = 0x11  # Session Expiry Interval
+                struct.pack_into("!I", buf, i + 2, self.session_expiry)
+            i += props
+        i = _put_str(buf, i, client_id)
         if self.lw_topic:
-            self._send_str(self.lw_topic)
-            self._send_str(self.lw_msg)
+            if props:
+                buf[i] = 0
+                i += 1
+            i = _put_str(buf, i, lw_topic)
+            i = _put_str(buf, i, lw_msg)
         if self.user is not None:
-            self._send_str(self.user)
-            self._send_str(self.pswd)
-        resp = self.sock.read(4)
-        assert resp[0] == 0x20 and resp[1] == 0x02
-        if resp[3] != 0:
-            raise MQTTException(resp[3])
-        return resp[2] & 1
+            i = _put_str(buf, i, user)
+            i = _put_str(buf, i, pswd)
+        self._send(i)
+
+    def _connack(self, pkt):
+        if pkt[1] != 0:
+            raise MQTTException(pkt[1])
+        if self.version == 5:
+            n, i = _get_len(pkt, 2)
+            end = i + n
+            while i < end:
+                p = pkt[i]
+                i += 1
+                if p == 0x22:  # Topic Alias Maximum
+                    self.alias_max = min(pkt[i] << 8 | pkt[i + 1], self.topic_aliases)
+                elif p == 0x13:  # Server Keep Alive overrides ours
+                    self.keepalive = pkt[i] << 8 | pkt[i + 1]
+                i += _prop_size(pkt, i, p)
+        self._last_rx = time.ticks_ms()
+        self._ping_sent = None
+        self._session_present = pkt[0] & 1
 
     def disconnect(self):
         self.sock.write(b"\xe0\0")
@@ -122,91 +388,410 @@ class MQTTClient:
 
     def ping(self):
         self.sock.write(b"\xc0\0")
+        self._last_tx = time.ticks_ms()
+        if self._ping_sent is None:
+            self._ping_sent = self._last_tx
+        self.pings += 1
 
-    def publish(self, topic, msg, retain=False, qos=0):
-        pkt = bytearray(b"\x30\0\0\0")
-        pkt[0] |= qos << 1 | retain
-        sz = 2 + len(topic) + len(msg)
+    def _keepalive(self):
+        # Pings an idle connection; raises once a PINGRESP is overdue, so
+        # a half-open connection is noticed within a bounded time
+        now = time.ticks_ms()
+        if self._ping_sent is not None:
+            if time.ticks_diff(now, self._ping_sent) >= self.ping_timeout_ms:
+                raise OSError(errno.ETIMEDOUT)
+        elif (
+            time.ticks_diff(now, self._last_tx) >= self.keepalive * 500
+            or time.ticks_diff(now, self._last_rx) >= self.keepalive * 500
+        ):
+            self.ping()
+
+    def _build_publish(self, topic, msg, retain, qos, pid):
+        # PUBLISH packet in the send buffer; returns its length
+        alias = 0
+        props = 0
+        if self.version == 5:
+            props = 1
+            if self.alias_max:
+                if topic in self._aliases:
+                    alias = self._aliases.index(topic) + 1
+                    topic = b""
+                elif len(self._aliases) < self.alias_max:
+                    self._aliases.append(topic)
+                    alias = len(self._aliases)
+                if alias:
+                    props = 4
+        topic = _buffer(topic)
+        msg = _buffer(msg)
+        sz = 2 + len(topic) + props + len(msg)
         if qos > 0:
             sz += 2
         assert sz < 2097152
-        i = 1
-        while sz > 0x7F:
-            pkt[i] = (sz & 0x7F) | 0x80
-            sz >>= 7
-            i += 1
-        pkt[i] = sz
-        self.sock.write(pkt[: i + 1])
-        self._send_str(topic)
+        buf = self._packet(sz + 4)
+        buf[0] = 0x30 | qos << 1 | retain
+        i = _put_str(buf, _put_len(buf, 1, sz), topic)
         if qos > 0:
-            self.pid += 1
-            pid = self.pid
-            struct.pack_into("!H", pkt, 0, pid)
-            self.sock.write(pkt[:2])
-        self.sock.write(msg)
-        if qos == 1:
+            struct.pack_into("!H", buf, i, pid)
+            i += 2
+        if props:
+            buf[i] = props - 1
+            if alias:
+                buf[i + 1] = 0x23  # Topic Alias
+                buf[i + 2] = alias >> 8
+                buf[i + 3] = alias & 0xFF
+            i += props
+        buf[i : i + len(msg)] = msg
+        return i + len(msg)
+
+    def publish(self, topic, msg, retain=False, qos=0):
+        if qos == 2:
+            # Goes through the in-flight table, which tracks the handshake
             while 1:
-                op = self.wait_msg()
-                if op == 0x40:
-                    sz = self.sock.read(1)
-                    assert sz == b"\x02"
-                    rcv_pid = self.sock.read(2)
-                    rcv_pid = rcv_pid[0] << 8 | rcv_pid[1]
-                    if pid == rcv_pid:
-                        return
-        elif qos == 2:
-            assert 0
+                pid = self.publish_nowait(topic, msg, retain, 2)
+                if pid is not None:
+                    break
+                self.wait_msg()
+            while self._slot(pid) >= 0:
+                self.wait_msg()
+            return
+        pid = self._next_pid() if qos > 0 else 0
+        self._send(self._build_publish(topic, msg, retain, qos, pid))
+        if qos == 1:
+            while self._ack_pid != pid:
+                self.wait_msg()
+
+    def publish_nowait(self, topic, msg, retain=False, qos=1):
+        # QoS 1 or 2 publish that returns without waiting for the acks. Up
+        # to `window` messages can be in flight; check_msg() matches their
+        # acks, answers PUBREC with PUBREL, and with MQTT 3.1.1 resends
+        # whatever is unacked after retry_ms (PUBLISH with DUP set, or the
+        # PUBREL). MQTT 5 only resends after a reconnect.
+        # Returns the packet id, or None if the window is full.
+        if self.inflight == self.window:
+            self.check_msg()  # Acks may be waiting in the socket
+            if self.inflight == self.window:
+                return None
+        pid = self._next_pid()
+        n = self._build_publish(topic, msg, retain, qos, pid)
+        self._send(n)
+        slot = self._slot(0)
+        self._flight_pid[slot] = pid
+        self._flight_state[slot] = _AWAIT_PUBACK if qos == 1 else _AWAIT_PUBREC
+        self._flight_time[slot] = time.ticks_ms()
+        self._flight_pkt[slot] = bytearray(self._view[:n])
+        self._flight_topic[slot] = topic if self.alias_max else None
+        self.inflight += 1
+        return pid
+
+    def _resume(self):
+        # After CONNACK: send the in-flight packets again with their packet
+        # ids. A resumed session requires it (MQTT-4.4.0-1), with DUP set and
+        # PUBREL for QoS 2 messages the broker already has. A new session
+        # has no state to match: the publishes go out again as new messages,
+        # and a QoS 2 message that reached PUBREC is complete.
+        present = self._session_present
+        if not present:
+            for j in range(len(self._rx_pids)):
+                self._rx_pids[j] = 0
+        now = time.ticks_ms()
+        for i in range(self.window):
+            pid = self._flight_pid[i]
+            if not pid:
+                continue
+            if self._flight_state[i] == _AWAIT_PUBCOMP:
+                if not present:
+                    self._complete(pid, _AWAIT_PUBCOMP)
+                    continue
+                self._send_ack(0x62, pid)  # PUBREL
+            else:
+                pkt = self._flight_pkt[i]
+                if self._flight_topic[i] is not None:
+                    pkt = self._flight_pkt[i] = self._republish(pkt, self._flight_topic[i], pid)
+                if present:
+                    pkt[0] |= 0x08  # DUP
+                else:
+                    pkt[0] &= 0xF7
+                self.sock.write(pkt)
+                self.retransmits += 1
+            self._flight_time[i] = now
+            self._last_tx = now
+
+    def _republish(self, pkt, topic, pid):
+        # pkt rebuilt with the full topic, for a connection without its alias
+        _, i = _get_len(pkt, 1)
+        i += 2 + (pkt[i] << 8 | pkt[i + 1]) + 2  # Topic and packet id
+        i += 1 + pkt[i]  # Properties (one length byte, they are short)
+        n = self._build_publish(topic, memoryview(pkt)[i:], pkt[0] & 1, pkt[0] >> 1 & 3, pid)
+        return bytearray(self._view[:n])
+
+    def _retry(self):
+        now = time.ticks_ms()
+        for i in range(self.window):
+            if self._flight_pid[i] and time.ticks_diff(now, self._flight_time[i]) >= self.retry_ms:
+                if self._flight_state[i] == _AWAIT_PUBCOMP:
+                    self._send_ack(0x62, self._flight_pid[i])  # PUBREL
+                else:
+                    pkt = self._flight_pkt[i]
+                    pkt[0] |= 0x08  # DUP
+                    self.sock.write(pkt)
+                self._flight_time[i] = now
+                self._last_tx = now
+                self.retransmits += 1
+
+    def _complete(self, pid, state):
+        # Frees pid's in-flight slot if it was waiting for this ack
+        slot = self._slot(pid)
+        if slot >= 0 and self._flight_state[slot] == state:
+            self._flight_pid[slot] = 0
+            self._flight_pkt[slot] = None
+            self._flight_topic[slot] = None
+            self.inflight -= 1
+            self.acked += 1
+            if self.ack_cb:
+                self.ack_cb(pid)
+
+    def stats(self):
+        return {
+            "inflight": self.inflight,
+            "window": self.window,
+            "acked": self.acked,
+            "retransmits": self.retransmits,
+            "dropped": self.dropped,
+            "pings": self.pings,
+            "ping_rtt_ms": self.ping_rtt_ms,
+            "version": self.version,
+            "topic_aliases": len(self._aliases),
+        }
 
     def subscribe(self, topic, qos=0):
+        pid = self._send_subscribe(topic, qos)
+        while self._suback_pid != pid:
+            self.wait_msg()
+
+    def subscribe_nowait(self, topic, qos=0):
+        # Sends SUBSCRIBE without waiting for the SUBACK; it is consumed
+        # later by check_msg(). topic may be a list or tuple of filters,
+        # all subscribed in one packet. Returns the packet id.
+        return self._send_subscribe(topic, qos)
+
+    def _send_subscribe(self, topics, qos):
         assert self.cb is not None, "Subscribe callback is not set"
-        pkt = bytearray(b"\x82\0\0\0")
-        self.pid += 1
-        struct.pack_into("!BH", pkt, 1, 2 + 2 + len(topic) + 1, self.pid)
-        self.sock.write(pkt)
-        self._send_str(topic)
-        self.sock.write(qos.to_bytes(1, "little"))
-        while 1:
-            op = self.wait_msg()
-            if op == 0x90:
-                resp = self.sock.read(4)
-                assert resp[1] == pkt[2] and resp[2] == pkt[3]
-                if resp[3] == 0x80:
-                    raise MQTTException(resp[3])
-                return
+        if not isinstance(topics, (list, tuple)):
+            topics = (topics,)
+        sz = 2
+        if self.version == 5:
+            sz += 1  # Empty properties
+        for topic in topics:
+            sz += 2 + len(_buffer(topic)) + 1
+        buf = self._packet(sz + 4)
+        pid = self._next_pid()
+        buf[0] = 0x82
+        i = _put_len(buf, 1, sz)
+        struct.pack_into("!H", buf, i, pid)
+        i += 2
+        if self.version == 5:
+            buf[i] = 0
+            i += 1
+        for topic in topics:
+            i = _put_str(buf, i, _buffer(topic))
+            buf[i] = qos
+            i += 1
+        self._send(i)
+        return pid
 
     def wait_msg(self):
-        res = self.sock.read(1)
-        self.sock.setblocking(True)
-        if res is None:
-            return None
-        if res == b"":
-            raise OSError(-1)
-        if res == b"\xd0":  # PINGRESP
-            sz = self.sock.read(1)[0]
-            assert sz == 0
-            return None
-        op = res[0]
-        if op & 0xF0 != 0x30:
-            return op
-        sz = self._recv_len()
-        topic_len = self.sock.read(2)
-        topic_len = (topic_len[0] << 8) | topic_len[1]
-        topic = self.sock.read(topic_len)
-        sz -= topic_len + 2
-        if op & 6:
-            pid = self.sock.read(2)
-            pid = pid[0] << 8 | pid[1]
-            sz -= 2
-        msg = self.sock.read(sz)
-        self.cb(topic, msg)
-        if op & 6 == 2:
-            pkt = bytearray(b"\x40\x02\0\0")
-            struct.pack_into("!H", pkt, 2, pid)
-            self.sock.write(pkt)
-        elif op & 6 == 4:
-            assert 0
-
-    def check_msg(self):
+        # Blocks until one packet has been received and handled; returns
+        # its type byte
+        while 1:
+            op = self._next_packet(True)
+            if op is not None:
+                return op
+
+    def check_msg(self, max_packets=16):
+        # Never blocks. Handles every complete packet already received,
+        # reading whatever the socket has available, but at most
+        # max_packets per call so a flood cannot stall the caller. A
+        # partially received packet stays buffered until the next call.
+        # Returns the type byte of the last packet handled, or None.
+        if self.keepalive:
+            self._keepalive()
+        if self.inflight and self.version != 5:
+            self._retry()  # MQTT 5 forbids resending on a live connection
+        op = None
+        for _ in range(max_packets):
+            res = self._next_packet(False)
+            if res is None:
+                break
+            op = res
+        return op
+
+    def _move(self, dst, src, n):
+        # Copy rbuf[src:src + n] down to dst in non-overlapping steps
+        step = src - dst
+        while n > 0:
+            k = min(n, step)
+            self._rbuf[dst : dst + k] = self._rview[src : src + k]
+            dst += k
+            src += k
+            n -= k
+
+    def _fill(self, block):
+        # Read what the socket has into the free end of the receive buffer.
+        # Returns False if nothing was available (non-blocking), raises on
+        # EOF. Reads are always non-blocking: a blocking readinto() would
+        # wait for the whole buffer to fill.
+        if self._rpos == self._rlen:
+            self._rpos = self._rlen = 0
+        elif self._rlen == len(self._rbuf):
+            # Full: move the partial packet to the front
+            n = self._rlen - self._rpos
+            self._move(0, self._rpos, n)
+            self._rpos = 0
+            self._rlen = n
         self.sock.setblocking(False)
-        return self.wait_msg()
+        try:
+            while 1:
+                try:
+                    n = self.sock.readinto(self._rview[self._rlen :])
+                except OSError as e:
+                    if e.args[0] != errno.EAGAIN:
+                        raise
+                    n = None
+                if n is not None or not block:
+                    break
+                poller = select.poll()
+                poller.register(self.sock, select.POLLIN)
+                if self.keepalive:
+                    # Wake up to keep pinging, and to give up on a dead
+                    # connection instead of waiting forever
+                    poller.poll(min(self.keepalive * 500, self.ping_timeout_ms))
+                    self._keepalive()
+                else:
+                    poller.poll()
+        finally:
+            self.sock.setblocking(True)
+        if n is None:
+            return False
+        if n == 0:
+            raise OSError(-1)
+        self._last_rx = time.ticks_ms()
+        if self._skip:
+            # Discard the rest of an oversized packet, keep what follows it
+            k = min(n, self._skip)
+            self._skip -= k
+            n -= k
+            self._move(self._rlen, self._rlen + k, n)
+        self._rlen += n
+        return True
+
+    def _next_packet(self, block):
+        # Parse one packet from the receive buffer, reading more as needed.
+        # Returns its type byte, or None if no complete packet is available
+        # (non-blocking only).
+        buf = self._rbuf
+        while 1:
+            avail = self._rlen - self._rpos
+            if avail >= 2 and not self._skip:
+                pos = self._rpos
+                sz = 0
+                sh = 0
+                i = pos + 1
+                while i < self._rlen and i < pos + 5:
+                    b = buf[i]
+                    sz |= (b & 0x7F) << sh
+                    i += 1
+                    if not b & 0x80:
+                        break
+                    sh += 7
+                else:
+                    sz = -1  # Length incomplete (or malformed, over 4 bytes)
+                    if avail >= 5:
+                        raise MQTTException("bad remaining length")
+                if sz >= 0:
+                    total = i - pos + sz
+                    if total <= avail:
+                        self._rpos = pos + total
+                        return self._handle(buf[pos], self._rview[i : pos + total])
+                    if total > self.max_packet:
+                        # Too big to buffer: drop it as it streams past
+                        self.dropped += 1
+                        self._skip = total - avail
+                        self._rpos = self._rlen = 0
+                    elif total > len(buf):
+                        # Grow to fit, keeping the bytes received so far
+                        buf = bytearray(total)
+                        buf[:avail] = self._rview[pos : self._rlen]
+                        self._rbuf = buf
+                        self._rview = memoryview(buf)
+                        self._rpos = 0
+                        self._rlen = avail
+            if not self._fill(block):
+                return None
 
+    def _handle(self, op, pkt):
+        # Dispatch one complete packet; pkt is a view of its variable
+        # header and payload, valid only during this call
+        kind = op & 0xF0
+        if kind == 0x30:  # PUBLISH
+            topic_len = pkt[0] << 8 | pkt[1]
+            i = 2 + topic_len
+            topic = bytes(pkt[2:i])
+            qos = op >> 1 & 3
+            if qos:
+                pid = pkt[i] << 8 | pkt[i + 1]
+                i += 2
+            if self.version == 5:
+                i = _skip_props(pkt, i)
+            if qos == 2:
+                # Deliver once: a resent PUBLISH (before PUBREL) is only
+                # acknowledged again
+                if pid not in self._rx_pids:
+                    self._rx_pids[self._rx_next] = pid
+                    self._rx_next = (self._rx_next + 1) % len(self._rx_pids)
+                    self.cb(topic, bytes(pkt[i:]))
+                self._send_ack(0x50, pid)  # PUBREC
+            else:
+                self.cb(topic, bytes(pkt[i:]))
+                if qos == 1:
+                    self._send_ack(0x40, pid)  # PUBACK
+        elif kind == 0x40:  # PUBACK
+            pid = pkt[0] << 8 | pkt[1]
+            self._ack_pid = pid
+            self._complete(pid, _AWAIT_PUBACK)
+        elif kind == 0x50:  # PUBREC
+            pid = pkt[0] << 8 | pkt[1]
+            slot = self._slot(pid)
+            if len(pkt) > 2 and pkt[2] >= 0x80:
+                # Refused (MQTT 5 reason code): nothing to release
+                self._complete(pid, _AWAIT_PUBREC)
+            else:
+                if slot >= 0 and self._flight_state[slot] == _AWAIT_PUBREC:
+                    # The broker owns the message now; only the PUBREL is resent
+                    self._flight_state[slot] = _AWAIT_PUBCOMP
+                    self._flight_time[slot] = time.ticks_ms()
+                    self._flight_pkt[slot] = None
+                    self._flight_topic[slot] = None
+                self._send_ack(0x62, pid)  # PUBREL
+        elif kind == 0x60:  # PUBREL
+            pid = pkt[0] << 8 | pkt[1]
+            for j in range(len(self._rx_pids)):
+                if self._rx_pids[j] == pid:
+                    self._rx_pids[j] = 0
+            self._send_ack(0x70, pid)  # PUBCOMP
+        elif kind == 0x70:  # PUBCOMP
+            self._complete(pkt[0] << 8 | pkt[1], _AWAIT_PUBCOMP)
+        elif kind == 0xD0:  # PINGRESP
+            if self._ping_sent is not None:
+                self.ping_rtt_ms = time.ticks_diff(time.ticks_ms(), self._ping_sent)
+                self._ping_sent = None
+        elif kind == 0x90:  # SUBACK
+            i = _skip_props(pkt, 2) if self.version == 5 else 2
+            for j in range(i, len(pkt)):
+                if pkt[j] >= 0x80:
+                    raise MQTTException(pkt[j])
+            self._suback_pid = pkt[0] << 8 | pkt[1]
+        elif kind == 0x20:  # CONNACK
+            self._connack(pkt)
+        elif kind == 0xE0:  # DISCONNECT (MQTT 5, sent by the broker)
+            raise MQTTException(pkt[0] if len(pkt) else 0)
+        return op
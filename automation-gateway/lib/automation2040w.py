@@ -3,7 +3,8 @@ Automation 2040 W Host Control Library
 ======================================
 
 Python library for controlling the Pimoroni Automation 2040 W
-over USB serial from a host computer.
+over USB serial from a host computer, or over the LAN from a board
+running the WiFi firmware (TCP command server, port 2040).
 
 Usage:
     from automation2040w import Automation2040W
@@ -15,6 +16,9 @@ Usage:
     board = Automation2040W('/dev/ttyACM0')  # Linux
     board = Automation2040W('COM3')          # Windows
 
+    # Or a WiFi board over TCP
+    board = Automation2040W('socket://192.168.1.50:2040')
+
     # Control relays
     board.relay(1, True)   # Turn on relay 1
     board.relay(2, False)  # Turn off relay 2
@@ -34,6 +38,9 @@ Usage:
     # Get all states
     status = board.status()  # Returns dict with all I/O states
 
+    # Pipeline several commands in one round trip
+    board.pipeline(["RELAY 1 ON", "RELAY 2 ON", "OUTPUT 1 50"])
+
 Author: Generated for Pimoroni Automation 2040 W
 License: MIT
 """
@@ -72,6 +79,9 @@ class Automation2040W:
     PICO_PID_PICO = 0x0005
     PICO_PID_PICOW = 0x000A
 
+    # TCP command server port of the WiFi firmware
+    DEFAULT_TCP_PORT = 2040
+
     def __init__(
         self,
         port: Optional[str] = None,
@@ -83,7 +93,8 @@ class Automation2040W:
         Initialize connection to Automation 2040 W.
 
         Args:
-            port: Serial port path. If None, auto-detect.
+            port: Serial port path or pyserial URL such as
+                  "socket://<board-ip>:2040" for a WiFi board. If None, auto-detect.
             baudrate: Serial baudrate (default 115200).
             timeout: Read timeout in seconds.
             auto_connect: Automatically connect on init.
@@ -139,11 +150,15 @@ class Automation2040W:
             self.port = ports[0]
 
         try:
-            self.serial = serial.Serial(self.port, baudrate=self.baudrate, timeout=self.timeout)
-            # Wait for board to be ready
-            time.sleep(0.5)
-            # Flush any startup messages
-            self.serial.reset_input_buffer()
+            if "://" in self.port:
+                # Network transport (e.g. socket://host:2040), no startup delay
+                self.serial = serial.serial_for_url(self.port, timeout=self.timeout)
+            else:
+                self.serial = serial.Serial(self.port, baudrate=self.baudrate, timeout=self.timeout)
+                # Wait for board to be ready
+                time.sleep(0.5)
+                # Flush any startup messages
+                self.serial.reset_input_buffer()
 
             # Test connection
             response = self._send_command("PING")
@@ -182,6 +197,20 @@ class Automation2040W:
         self.serial.write(f"{command}\n".encode())
         self.serial.flush()
 
+        return self._read_response()
+
+    def _read_response(self) -> str:
+        """
+        Read one response from the board.
+
+        Returns:
+            Response string (without OK prefix).
+
+        Raises:
+            CommandError: If the board reported an error or did not respond.
+        """
+        assert self.serial is not None
+
         # Read response (handle multi-line responses like HELP)
         lines = []
         while True:
@@ -211,6 +240,45 @@ class Automation2040W:
 
         return response
 
+    def pipeline(self, commands: list[str]) -> list[str]:
+        """
+        Send several commands at once and collect their responses.
+
+        All commands go out in a single write and the responses are read
+        afterwards, so a batch costs one round trip instead of one per
+        command. This matters most over TCP to a WiFi board.
+
+        Args:
+            commands: Command strings, e.g. ["RELAY 1 ON", "OUTPUT 2 50"].
+
+        Returns:
+            Response strings (without OK prefix), in command order.
+
+        Raises:
+            CommandError: If any command failed. All responses are read
+                first so the connection stays in sync.
+        """
+        if not self.serial or not self.serial.is_open:
+            raise CommandError("Not connected to board")
+        if not commands:
+            return []
+
+        self.serial.write("".join(f"{command}\n" for command in commands).encode())
+        self.serial.flush()
+
+        responses: list[str] = []
+        errors: list[str] = []
+        for command in commands:
+            try:
+                responses.append(self._read_response())
+            except CommandError as e:
+                responses.append("")
+                errors.append(f"{command}: {e}")
+
+        if errors:
+            raise CommandError("; ".join(errors))
+        return responses
+
     @property
     def version(self) -> str:
         """Get firmware version."""
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+Data Log Download Example
+=========================
+
+Fetches the flash data log of a WiFi board (LOG_ENABLED in config.py)
+over HTTP and prints the records as CSV. With --follow, it keeps polling
+and uses HTTP Range requests to fetch only the bytes added since the
+last download.
+
+Usage:
+    python3 download_log.py 192.168.1.50 > log.csv
+    python3 download_log.py 192.168.1.50 --follow
+"""
+
+import argparse
+import struct
+import time
+import urllib.error
+import urllib.request
+
+RECORD = struct.Struct("<BBBBII4B4HBBHHH")
+MAGIC = 0xA2
+
+
+def fetch(host, start=0):
+    """Return (first_seq, total_size, data) for log bytes from `start` on."""
+    req = urllib.request.Request(f"http://{host}/api/log")
+    if start:
+        req.add_header("Range", f"bytes={start}-")
+    try:
+        with urllib.request.urlopen(req, timeout=10) as resp:
+            data = resp.read()
+            first_seq = int(resp.headers.get("X-First-Seq", 0))
+            content_range = resp.headers.get("Content-Range")
+            total = int(content_range.split("/")[1]) if content_range else len(data)
+            return first_seq, total, data
+    except urllib.error.HTTPError as e:
+        if e.code == 416:  # Nothing new
+            return None, int(e.headers.get("Content-Range", "*/0").split("/")[1]), b""
+        raise
+
+
+def print_records(data):
+    for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        f = RECORD.unpack_from(data, offset)
+        if f[0] != MAGIC or sum(data[offset : offset + 30]) & 0xFFFF != f[18]:
+            continue  # Corrupt record
+        kind = "edge" if f[1] == 2 else "sample"
+        relays = "".join("1" if f[2] >> i & 1 else "0" for i in range(3))
+        inputs = "".join("1" if f[3] >> i & 1 else "0" for i in range(4))
+        adcs = ",".join(f"{mv / 1000:.3f}" for mv in f[10:13])
+        edge = f"{f[14] + 1},{'HIGH' if f[15] else 'LOW'},{f[16]}" if f[1] == 2 else ",,"
+        print(f"{f[4]},{f[5]},{kind},{relays},{inputs},{f[6]},{f[7]},{f[8]},{adcs},{edge}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Download the flash data log of a WiFi board")
+    parser.add_argument("host", help="WiFi board IP address")
+    parser.add_argument("--follow", action="store_true", help="Keep fetching new records")
+    parser.add_argument("--interval", type=float, default=10.0, help="Seconds between fetches")
+    args = parser.parse_args()
+
+    print("seq,time,kind,relays,inputs,out1,out2,out3,adc1,adc2,adc3,input,state,count")
+    first_seq, offset, data = fetch(args.host)
+    print_records(data)
+
+    while args.follow:
+        time.sleep(args.interval)
+        wanted = first_seq + offset // RECORD.size
+        seq, total, data = fetch(args.host, offset)
+        if seq is not None and seq != first_seq:
+            # Old segments were recycled, so byte offsets moved: resync by sequence
+            first_seq = seq
+            offset = max(0, (wanted - seq) * RECORD.size)
+            _, total, data = fetch(args.host, offset)
+        print_records(data)
+        offset = total
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Round-Trip Latency Comparison
+=============================
+
+Measures relay-write round-trip time to a WiFi board over the three
+LAN interfaces of the WiFi firmware:
+
+- TCP line protocol (port 2040), single commands and pipelined batches
+- HTTP REST API (POST /api/relay/N)
+- MQTT (publish automation/command STATUS, wait for automation/status)
+
+Usage:
+    python3 latency.py 192.168.1.50 --broker 192.168.1.28
+"""
+
+import argparse
+import statistics
+import sys
+import threading
+import time
+import urllib.request
+
+sys.path.insert(0, "../..")
+from lib.automation2040w import Automation2040W
+
+
+def summarize(name, samples):
+    """Print median / p95 / max in milliseconds."""
+    if not samples:
+        print(f"{name:<28} no samples")
+        return
+    ms = sorted(s * 1000 for s in samples)
+    p95 = ms[min(len(ms) - 1, int(len(ms) * 0.95))]
+    print(
+        f"{name:<28} median {statistics.median(ms):7.2f} ms   "
+        f"p95 {p95:7.2f} ms   max {ms[-1]:7.2f} ms   (n={len(ms)})"
+    )
+
+
+def bench_tcp(host, port, count):
+    board = Automation2040W(f"socket://{host}:{port}")
+    single = []
+    for i in range(count):
+        start = time.perf_counter()
+        board.relay(1, i % 2 == 0)
+        single.append(time.perf_counter() - start)
+
+    batch = ["RELAY 1 ON", "RELAY 2 ON", "RELAY 3 ON", "RELAY 1 OFF", "RELAY 2 OFF", "RELAY 3 OFF"]
+    pipelined = []
+    for _ in range(count):
+        start = time.perf_counter()
+        board.pipeline(batch)
+        pipelined.append((time.perf_counter() - start) / len(batch))
+    board.disconnect()
+    return single, pipelined
+
+
+def bench_http(host, count):
+    samples = []
+    for i in range(count):
+        body = b'{"state": true}' if i % 2 == 0 else b'{"state": false}'
+        req = urllib.request.Request(
+            f"http://{host}/api/relay/1",
+            data=body,
+            headers={"Content-Type": "application/json"},
+            method="POST",
+        )
+        start = time.perf_counter()
+        with urllib.request.urlopen(req, timeout=5) as resp:
+            resp.read()
+        samples.append(time.perf_counter() - start)
+    return samples
+
+
+def bench_mqtt(broker, topic, count):
+    import paho.mqtt.client as mqtt
+
+    got = threading.Event()
+    client = mqtt.Client()
+    client.on_message = lambda c, u, m: got.set()
+    client.connect(broker, 1883, 60)
+    client.subscribe(f"{topic}/status")
+    client.loop_start()
+
+    samples = []
+    for _ in range(count):
+        time.sleep(0.05)  # Let any periodic status publish pass
+        got.clear()
+        start = time.perf_counter()
+        client.publish(f"{topic}/command", "STATUS")
+        if got.wait(5):
+            samples.append(time.perf_counter() - start)
+    client.loop_stop()
+    client.disconnect()
+    return samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare TCP / HTTP / MQTT round-trip time")
+    parser.add_argument("host", help="WiFi board IP address")
+    parser.add_argument("--tcp-port", type=int, default=Automation2040W.DEFAULT_TCP_PORT)
+    parser.add_argument("--broker", help="MQTT broker (skip MQTT if omitted)")
+    parser.add_argument("--topic", default="automation", help="MQTT topic prefix")
+    parser.add_argument("--count", type=int, default=50, help="Round trips per transport")
+    args = parser.parse_args()
+
+    print(f"Measuring {args.count} round trips per transport against {args.host}")
+    print("-" * 80)
+
+    single, pipelined = bench_tcp(args.host, args.tcp_port, args.count)
+    summarize("TCP (one command)", single)
+    summarize("TCP (pipelined, per cmd)", pipelined)
+    summarize("HTTP POST /api/relay/1", bench_http(args.host, args.count))
+    if args.broker:
+        summarize("MQTT command -> status", bench_mqtt(args.broker, args.topic, args.count))
+
+
+if __name__ == "__main__":
+    main()
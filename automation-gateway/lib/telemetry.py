@@ -0,0 +1,258 @@
+"""
+Automation 2040 W UDP Telemetry Receiver
+========================================
+
+Receives the binary status frames sent by the WiFi firmware
+(TELEMETRY_INTERVAL in config.py) and keeps the latest state of every
+board on the LAN, together with packet loss statistics derived from the
+frame sequence numbers.
+
+Usage:
+    from lib.telemetry import TelemetryReceiver
+
+    receiver = TelemetryReceiver()          # joins 239.20.40.1:20400
+    while True:
+        receiver.poll(timeout=1.0)
+        for board in receiver.boards.values():
+            print(board.board_id, board.relays, board.adcs, f"{board.loss:.1%}")
+
+Run as a script to print a live table:
+    python3 -m lib.telemetry [group] [port]
+
+License: MIT
+"""
+
+import socket
+import struct
+import time
+from dataclasses import dataclass, field
+from typing import Optional
+
+MAGIC = b"A2"
+FRAME_VERSION = 1
+HEADER = struct.Struct("!2sBB6sIIBBBB")
+
+DEFAULT_GROUP = "239.20.40.1"
+DEFAULT_PORT = 20400
+
+# Sequence numbers wrap at 2^30 (a MicroPython small int)
+SEQ_MASK = 0x3FFFFFFF
+# A sequence jump larger than this is treated as a reboot, not as loss
+RESTART_THRESHOLD = 1 << 29
+
+
+class FrameError(ValueError):
+    """Datagram is not a valid telemetry frame."""
+
+    pass
+
+
+@dataclass
+class Frame:
+    """One decoded telemetry frame."""
+
+    board_id: str
+    seq: int
+    uptime_ms: int
+    wifi_connected: bool
+    mqtt_connected: bool
+    relays: list[bool]
+    inputs: list[bool]
+    outputs: list[int]
+    adcs: list[float]
+
+
+@dataclass
+class BoardState:
+    """Latest state and reception statistics for one board."""
+
+    board_id: str
+    address: str
+    last: Frame
+    last_seen: float
+    received: int = 1
+    lost: int = 0
+    duplicates: int = 0
+    restarts: int = 0
+    _expected: int = field(default=0, repr=False)
+
+    @property
+    def relays(self) -> list[bool]:
+        return self.last.relays
+
+    @property
+    def inputs(self) -> list[bool]:
+        return self.last.inputs
+
+    @property
+    def outputs(self) -> list[int]:
+        return self.last.outputs
+
+    @property
+    def adcs(self) -> list[float]:
+        return self.last.adcs
+
+    @property
+    def loss(self) -> float:
+        """Fraction of frames lost since the first frame was received."""
+        total = self.received + self.lost
+        return self.lost / total if total else 0.0
+
+
+def decode_frame(data: bytes) -> Frame:
+    """
+    Decode one telemetry datagram.
+
+    Raises:
+        FrameError: If the datagram is malformed or of an unknown version.
+    """
+    if len(data) < HEADER.size:
+        raise FrameError(f"Frame too short ({len(data)} bytes)")
+    magic, version, flags, board_id, seq, uptime, counts_a, counts_b, relay_bits, input_bits = (
+        HEADER.unpack_from(data)
+    )
+    if magic != MAGIC:
+        raise FrameError("Bad magic")
+    if version != FRAME_VERSION:
+        raise FrameError(f"Unsupported frame version {version}")
+
+    num_relays, num_outputs = counts_a >> 4, counts_a & 0x0F
+    num_inputs, num_adcs = counts_b >> 4, counts_b & 0x0F
+    expected = HEADER.size + num_outputs + 2 * num_adcs
+    if len(data) < expected:
+        raise FrameError(f"Frame truncated ({len(data)} of {expected} bytes)")
+
+    pos = HEADER.size
+    outputs = list(data[pos : pos + num_outputs])
+    pos += num_outputs
+    millivolts = struct.unpack_from(f"!{num_adcs}H", data, pos)
+
+    return Frame(
+        board_id=board_id.hex(":"),
+        seq=seq,
+        uptime_ms=uptime,
+        wifi_connected=bool(flags & 0x01),
+        mqtt_connected=bool(flags & 0x02),
+        relays=[bool(relay_bits >> i & 1) for i in range(num_relays)],
+        inputs=[bool(input_bits >> i & 1) for i in range(num_inputs)],
+        outputs=outputs,
+        adcs=[mv / 1000.0 for mv in millivolts],
+    )
+
+
+class TelemetryReceiver:
+    """Collects telemetry frames from all boards on the LAN."""
+
+    def __init__(
+        self, group: str = DEFAULT_GROUP, port: int = DEFAULT_PORT, interface: str = "0.0.0.0"
+    ):
+        """
+        Args:
+            group: Multicast group to join, or "" to only receive broadcast/unicast.
+            port: UDP port the boards send to.
+            interface: Local interface address for the multicast membership.
+        """
+        self.boards: dict[str, BoardState] = {}
+        self.invalid = 0
+
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.bind(("", port))
+        if group:
+            membership = socket.inet_aton(group) + socket.inet_aton(interface)
+            self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+
+    def poll(self, timeout: Optional[float] = None) -> list[BoardState]:
+        """
+        Wait for datagrams and process every one that is available.
+
+        Args:
+            timeout: Seconds to wait for the first datagram (None blocks).
+
+        Returns:
+            Boards whose state was updated.
+        """
+        updated: dict[str, BoardState] = {}
+        self.sock.settimeout(timeout)
+        try:
+            data, addr = self.sock.recvfrom(512)
+        except (socket.timeout, BlockingIOError):
+            return []
+
+        self.sock.setblocking(False)
+        while True:
+            board = self.feed(data, addr[0])
+            if board is not None:
+                updated[board.board_id] = board
+            try:
+                data, addr = self.sock.recvfrom(512)
+            except BlockingIOError:
+                break
+        return list(updated.values())
+
+    def feed(self, data: bytes, address: str = "") -> Optional[BoardState]:
+        """Process one datagram. Returns the updated board, or None if invalid/stale."""
+        try:
+            frame = decode_frame(data)
+        except FrameError:
+            self.invalid += 1
+            return None
+
+        now = time.monotonic()
+        board = self.boards.get(frame.board_id)
+        if board is None:
+            board = BoardState(frame.board_id, address, frame, now)
+            board._expected = (frame.seq + 1) & SEQ_MASK
+            self.boards[frame.board_id] = board
+            return board
+
+        gap = (frame.seq - board._expected) & SEQ_MASK
+        if gap >= RESTART_THRESHOLD:
+            # Older than expected: duplicate or late reordered frame
+            if frame.uptime_ms < board.last.uptime_ms and frame.seq < board.last.seq:
+                # Sequence went backwards together with uptime: board rebooted
+                board.restarts += 1
+            else:
+                board.duplicates += 1
+                return None
+        else:
+            board.lost += gap
+
+        board.last = frame
+        board.last_seen = now
+        board.address = address or board.address
+        board.received += 1
+        board._expected = (frame.seq + 1) & SEQ_MASK
+        return board
+
+    def close(self) -> None:
+        self.sock.close()
+
+
+def main() -> None:
+    import sys
+
+    group = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_GROUP
+    port = int(sys.argv[2]) if len(sys.argv) > 2 else DEFAULT_PORT
+    receiver = TelemetryReceiver(group, port)
+    print(f"Listening for telemetry on {group or '*'}:{port} (Ctrl+C to exit)")
+
+    try:
+        while True:
+            for board in receiver.poll(timeout=1.0):
+                relays = "".join("1" if r else "0" for r in board.relays)
+                inputs = "".join("1" if i else "0" for i in board.inputs)
+                adcs = " ".join(f"{v:6.3f}" for v in board.adcs)
+                print(
+                    f"{board.board_id} seq={board.last.seq:<8} R[{relays}] I[{inputs}] "
+                    f"O{board.outputs} A[{adcs}] rx={board.received} lost={board.lost} "
+                    f"({board.loss:.2%})"
+                )
+    except KeyboardInterrupt:
+        pass
+    finally:
+        receiver.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -160,28 +160,16 @@ class AutomationService:
         @app.route("/api/health")
         def health():
             """Health check endpoint."""
-            uptime = (datetime.now() - self.start_time).total_seconds()
-            mqtt_config = self.config["mqtt"]
-            return jsonify(
-                {
-                    "status": "healthy" if self.running else "stopped",
-                    "uptime_seconds": uptime,
-                    "board_connected": self.board_connected,
-                    "mqtt_connected": self.mqtt_connected,
-                    "mqtt_broker": f"{mqtt_config['broker']}:{mqtt_config['port']}",
-                    "mqtt_topic_prefix": mqtt_config["topic_prefix"],
-                    "error_count": self.error_count,
-                    "last_update": datetime.now().isoformat(),
-                }
-            )
+            return jsonify(self.health())
 
         @app.route("/api/status")
         def status():
-            """Get current board status."""
+            """Get current board status; with ?health=1 the health check is included."""
+            extra = {"health": self.health()} if request.args.get("health") else {}
             if not self.board_connected:
-                return jsonify({"error": "Board not connected"}), 503
+                return jsonify({"error": "Board not connected", **extra}), 503
 
-            return jsonify(self.last_status)
+            return jsonify({**self.last_status, **extra})
 
         @app.route("/api/relay/<int:relay_num>", methods=["POST"])
         def control_relay(relay_num):
@@ -231,6 +219,38 @@ class AutomationService:
                 self.logger.error(f"Output control error: {e}")
                 return jsonify({"error": str(e)}), 500
 
+        @app.route("/api/io", methods=["POST"])
+        def control_io():
+            """Set several relays and outputs at once (one serial round trip)."""
+            if not self.board_connected:
+                self.logger.warning("API: I/O batch rejected - board not connected")
+                return jsonify({"error": "Board not connected"}), 503
+
+            data = request.get_json(silent=True) or {}
+            relays: dict[str, bool] = {}
+            outputs: dict[str, int] = {}
+            try:
+                for num, state in (data.get("relays") or {}).items():
+                    if not 1 <= int(num) <= 3:
+                        raise ValueError("Relay number must be between 1 and 3")
+                    relays[str(int(num))] = bool(state)
+                for num, value in (data.get("outputs") or {}).items():
+                    if not 1 <= int(num) <= 3:
+                        raise ValueError("Output number must be between 1 and 3")
+                    outputs[str(int(num))] = max(0, min(100, int(value)))
+            except (AttributeError, TypeError, ValueError) as e:
+                return jsonify({"error": str(e)}), 400
+
+            commands = [f"RELAY {num} {'ON' if state else 'OFF'}" for num, state in relays.items()]
+            commands += [f"OUTPUT {num} {percent}" for num, percent in outputs.items()]
+            try:
+                self.logger.info(f"API: Applying {len(commands)} I/O changes")
+                self.board.pipeline(commands)
+                return jsonify({"status": "ok", "relays": relays, "outputs": outputs})
+            except Exception as e:
+                self.logger.error(f"I/O batch error: {e}")
+                return jsonify({"error": str(e)}), 500
+
         @app.route("/api/reset", methods=["POST"])
         def reset():
             """Reset all outputs."""
@@ -246,6 +266,21 @@ class AutomationService:
                 self.logger.error(f"Reset error: {e}")
                 return jsonify({"error": str(e)}), 500
 
+    def health(self) -> dict[str, Any]:
+        """Service health, as served by /api/health."""
+        uptime = (datetime.now() - self.start_time).total_seconds()
+        mqtt_config = self.config["mqtt"]
+        return {
+            "status": "healthy" if self.running else "stopped",
+            "uptime_seconds": uptime,
+            "board_connected": self.board_connected,
+            "mqtt_connected": self.mqtt_connected,
+            "mqtt_broker": f"{mqtt_config['broker']}:{mqtt_config['port']}",
+            "mqtt_topic_prefix": mqtt_config["topic_prefix"],
+            "error_count": self.error_count,
+            "last_update": datetime.now().isoformat(),
+        }
+
     def connect_board(self) -> bool:
         """Connect to the Automation 2040 W board."""
         serial_config = self.config["serial"]
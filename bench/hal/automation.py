@@ -0,0 +1,61 @@
+"""
+Stand-in for the Pimoroni automation library on the MicroPython unix port
+and CPython, so the firmware can run off-target. I/O state lives in
+sim.py, shared with the machine stand-in (input GPIOs, raw ADCs); nothing
+touches hardware.
+"""
+
+import sim
+from sim import VOLTAGE_GAIN, VOLTAGE_OFFSET  # noqa: F401 - re-exported like the library
+
+SWITCH_A = 0
+SWITCH_B = 1
+
+
+class Automation2040W:
+    NUM_RELAYS = 3
+    NUM_OUTPUTS = 3
+    NUM_INPUTS = 4
+    NUM_ADCS = 3
+
+    def __init__(self):
+        self.reset()
+
+    def relay(self, relay, state=None):
+        if state is None:
+            return sim.relays[relay]
+        sim.relays[relay] = bool(state)
+
+    def output(self, output, value=None):
+        if value is None:
+            return sim.outputs[output]
+        sim.outputs[output] = value
+
+    def read_input(self, input):
+        return sim.inputs[input]
+
+    def read_adc(self, adc):
+        return (sim.adc_u16(adc) * 3.3 / 65535 + VOLTAGE_OFFSET) / VOLTAGE_GAIN
+
+    def switch_pressed(self, switch):
+        return sim.switches[switch]
+
+    def switch_led(self, switch, brightness):
+        sim.leds[switch] = brightness
+
+    def reset(self):
+        for i in range(len(sim.relays)):
+            sim.relays[i] = False
+        for i in range(len(sim.outputs)):
+            sim.outputs[i] = 0.0
+        sim.leds[0] = sim.leds[1] = 0
+
+
+class Automation2040WMini(Automation2040W):
+    NUM_RELAYS = 1
+    NUM_OUTPUTS = 2
+    NUM_INPUTS = 2
+    NUM_ADCS = 3
+
+    def relay(self, state=None):
+        return Automation2040W.relay(self, 0, state)
@@ -0,0 +1,108 @@
+"""
+Stand-in for the rp2 machine module, backed by sim.py.
+
+Input GPIOs read the simulated inputs and fire IRQs on their edges; ADC
+channels read the simulated waveforms. idle() and lightsleep() sleep the
+host thread, reset() exits the process.
+"""
+
+import sys
+import time
+
+import sim
+
+_NO_ARG = object()
+
+
+class IRQ:
+    """Pin IRQ object; flags() is the edge that fired the handler."""
+
+    def __init__(self):
+        self._flags = 0
+
+    def flags(self):
+        return self._flags
+
+
+class Pin:
+    IN = 0
+    OUT = 1
+    OPEN_DRAIN = 2
+    PULL_UP = 1
+    PULL_DOWN = 2
+    IRQ_FALLING = sim.IRQ_FALLING
+    IRQ_RISING = sim.IRQ_RISING
+
+    def __init__(self, id, mode=-1, pull=-1, value=None):
+        self.id = id
+        self._irq = IRQ()
+        self._value = 0
+        if value is not None:
+            self.value(value)
+
+    def value(self, value=None):
+        if value is None:
+            if self.id in sim.INPUT_GPIOS:
+                return sim.gpio_value(self.id)
+            return self._value
+        self._value = 1 if value else 0
+
+    __call__ = value
+
+    def on(self):
+        self.value(1)
+
+    def off(self):
+        self.value(0)
+
+    def toggle(self):
+        self.value(1 - self._value)
+
+    def irq(self, handler=_NO_ARG, trigger=IRQ_FALLING | IRQ_RISING, hard=False):
+        if handler is not _NO_ARG:
+            sim.set_irq(self.id, handler, trigger, self)
+        return self._irq
+
+
+class ADC:
+    CORE_TEMP = 4
+
+    def __init__(self, pin):
+        pin = getattr(pin, "id", pin)
+        self.channel = pin - sim.ADC_GPIOS[0] if pin >= sim.ADC_GPIOS[0] else pin
+
+    def read_u16(self):
+        if self.channel < len(sim.adc_waves):
+            return sim.adc_u16(self.channel)
+        return 14000  # Core temperature sensor, about 20 C
+
+
+def disable_irq():
+    sim.irq_lock.acquire()
+    return 1
+
+
+def enable_irq(state):
+    if state:
+        sim.irq_lock.release()
+
+
+def idle():
+    time.sleep_ms(1)
+
+
+def lightsleep(ms=None):
+    time.sleep_ms(ms or 1)
+
+
+def reset():
+    print("machine.reset()")
+    sys.exit(0)
+
+
+def unique_id():
+    return b"\xe6\x61\x41\x04\x03\x2b\x20\x40"
+
+
+def freq(hz=None):
+    return 125000000
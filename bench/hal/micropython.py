@@ -0,0 +1,54 @@
+"""
+Stand-in for the micropython module under CPython (the unix port has
+the real one, which shadows this file).
+
+schedule() queues like the board's scheduler (8 entries, RuntimeError
+when full). sim.py runs the queue after each simulated IRQ, on its own
+thread, so callbacks interrupt the main loop much as they do on the
+board.
+"""
+
+import _thread
+
+_queue = []
+_lock = _thread.allocate_lock()
+
+
+def const(value):
+    return value
+
+
+def native(f):
+    return f
+
+
+viper = native
+
+
+def schedule(func, arg):
+    if len(_queue) >= 8:
+        raise RuntimeError("schedule queue full")
+    _queue.append((func, arg))
+
+
+def run_scheduled():
+    with _lock:
+        while _queue:
+            func, arg = _queue.pop(0)
+            func(arg)
+
+
+def alloc_emergency_exception_buf(size):
+    pass
+
+
+def heap_lock():
+    return 0
+
+
+def heap_unlock():
+    return 0
+
+
+def mem_info(verbose=False):
+    print("mem_info: not available under CPython")
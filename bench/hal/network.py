@@ -0,0 +1,83 @@
+"""
+Stand-in for the cyw43 network module. The station "associates" a
+moment after connect() with any credentials, and from then on the
+firmware's sockets are the host's: it is reachable on the host's
+addresses and reaches brokers and servers through the host network.
+"""
+
+import socket
+import time
+
+STA_IF = 0
+AP_IF = 1
+
+STAT_IDLE = 0
+STAT_CONNECTING = 1
+STAT_GOT_IP = 3
+
+ASSOCIATE_MS = 200  # Time from connect() to connected
+
+
+def host_ip():
+    """Host address used for outgoing traffic (no packets are sent)."""
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.connect(socket.getaddrinfo("192.0.2.1", 9)[0][-1])
+        return s.getsockname()[0]
+    except (OSError, AttributeError):
+        return "127.0.0.1"
+    finally:
+        s.close()
+
+
+class WLAN:
+    def __init__(self, interface=STA_IF):
+        self.interface = interface
+        self._active = False
+        self._connect_at = None
+        self._ssid = None
+        self._pm = 0xA11140
+        self._ip = None
+
+    def active(self, state=None):
+        if state is None:
+            return self._active
+        self._active = bool(state)
+
+    def connect(self, ssid=None, key=None, **kwargs):
+        self._active = True
+        self._ssid = ssid
+        self._connect_at = time.ticks_add(time.ticks_ms(), ASSOCIATE_MS)
+
+    def disconnect(self):
+        self._connect_at = None
+
+    def isconnected(self):
+        return (self._connect_at is not None
+                and time.ticks_diff(time.ticks_ms(), self._connect_at) >= 0)
+
+    def status(self, param=None):
+        if param == "rssi":
+            return -55
+        if self.isconnected():
+            return STAT_GOT_IP
+        return STAT_CONNECTING if self._connect_at is not None else STAT_IDLE
+
+    def ifconfig(self):
+        if self._ip is None:
+            self._ip = host_ip()
+        ip = self._ip if self.isconnected() else "0.0.0.0"
+        return (ip, "255.255.255.0", "0.0.0.0", "0.0.0.0")
+
+    def config(self, *args, **kwargs):
+        if "pm" in kwargs:
+            self._pm = kwargs["pm"]
+        if not args:
+            return None
+        if args[0] == "mac":
+            return b"\x28\xcd\xc1\x00\x20\x40"
+        if args[0] == "ssid":
+            return self._ssid
+        if args[0] == "pm":
+            return self._pm
+        raise ValueError("unknown config param")
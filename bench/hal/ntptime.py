@@ -0,0 +1,8 @@
+"""Stand-in for ntptime: the host clock is already set."""
+
+host = "pool.ntp.org"
+timeout = 1
+
+
+def settime():
+    pass
@@ -0,0 +1,137 @@
+"""
+Simulated Automation 2040 W Hardware
+====================================
+
+Board state shared by the stand-in automation, machine and network
+modules in this directory. Nothing runs until start() is called, so
+benchmarks that only need the automation stand-in see fixed values.
+
+Once started, a background thread advances the inputs every
+millisecond. They follow square waves (input_period_ms, 0 = hold the
+level); a change fires the IRQ handler registered on the input's GPIO,
+from the simulation thread, like a hard IRQ on the board.
+
+ADCs follow adc_waves: (shape, low volts, high volts, period ms) with
+shape "sine", "ramp", "square" or "const". They are evaluated when read,
+so, like the thread, they allocate nothing the firmware did not ask for
+(memory_bench.py counts every heap allocation in the process).
+
+Relays, outputs, switch LEDs and buttons are plain lists; a driver script
+can read or change them while the firmware runs.
+"""
+
+import _thread
+import math
+import time
+
+# CPython: micropython.schedule() callbacks queued by an IRQ handler are
+# run after it (the unix port runs them itself)
+try:
+    from micropython import run_scheduled
+except ImportError:
+    run_scheduled = None
+
+INPUT_GPIOS = (19, 20, 21, 22)
+ADC_GPIOS = (26, 27, 28)
+
+# Divider calibration, as in the Pimoroni automation library
+VOLTAGE_GAIN = 0.28058608
+VOLTAGE_OFFSET = -0.06
+
+relays = [False] * 3
+outputs = [0.0] * 3
+inputs = [False] * 4
+switches = [False, False]
+leds = [0, 0]
+
+input_period_ms = [0, 0, 0, 0]
+adc_waves = [
+    ("sine", 0.0, 12.0, 10000),
+    ("ramp", 0.0, 24.0, 30000),
+    ("const", 3.3, 3.3, 0),
+]
+
+irq_lock = _thread.allocate_lock()  # Held while an IRQ handler runs (machine.disable_irq)
+_irqs = {}  # GPIO -> (handler, trigger, pin)
+_started = False
+_start_ms = 0
+
+IRQ_FALLING = 4
+IRQ_RISING = 8
+
+
+def set_irq(gpio, handler, trigger, pin):
+    if handler is None:
+        _irqs.pop(gpio, None)
+    else:
+        _irqs[gpio] = (handler, trigger, pin)
+
+
+def gpio_value(gpio):
+    if gpio in INPUT_GPIOS:
+        return int(inputs[INPUT_GPIOS.index(gpio)])
+    return 0
+
+
+def set_input(index, level):
+    """Change an input and fire its edge IRQ, as the buffered input would."""
+    level = bool(level)
+    if inputs[index] == level:
+        return
+    inputs[index] = level
+    irq = _irqs.get(INPUT_GPIOS[index])
+    edge = IRQ_RISING if level else IRQ_FALLING
+    if irq and irq[1] & edge:
+        irq[2]._irq._flags = edge
+        with irq_lock:
+            irq[0](irq[2])
+        if run_scheduled is not None:
+            run_scheduled()
+
+
+def adc_volts(index):
+    """Current level of ADC `index` (at time 0 before start())."""
+    t = time.ticks_diff(time.ticks_ms(), _start_ms) if _started else 0
+    shape, low, high, period = adc_waves[index]
+    return _wave(shape, low, high, period, t)
+
+
+def adc_u16(index):
+    """Raw reading that read_adc() converts back to adc_volts(index)."""
+    raw = int((adc_volts(index) * VOLTAGE_GAIN - VOLTAGE_OFFSET) * 65535 / 3.3 + 0.5)
+    return max(0, min(65535, raw))
+
+
+def _wave(shape, low, high, period, t):
+    if shape == "const" or not period:
+        return low
+    phase = (t % period) / period
+    if shape == "sine":
+        return low + (high - low) * (0.5 + 0.5 * math.sin(2 * math.pi * phase))
+    if shape == "ramp":
+        return low + (high - low) * phase
+    return high if phase < 0.5 else low  # square
+
+
+def step(now_ms):
+    t = time.ticks_diff(now_ms, _start_ms)
+    for i in range(len(input_period_ms)):
+        period = input_period_ms[i]
+        if period:
+            set_input(i, (t // (period // 2)) % 2 == 1)
+
+
+def _run():
+    while True:
+        step(time.ticks_ms())
+        time.sleep_ms(1)
+
+
+def start():
+    """Start the simulation thread (once)."""
+    global _started, _start_ms
+    if not _started:
+        _started = True
+        _start_ms = time.ticks_ms()
+        step(_start_ms)
+        _thread.start_new_thread(_run, ())
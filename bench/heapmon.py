@@ -0,0 +1,124 @@
+"""
+Heap Monitor
+============
+
+Samples the heap of the firmware process from a background thread and
+reports it as JSON to whoever connects to a local TCP port; used by
+run_firmware.py (stats=PORT) for memory_bench.py.
+
+On MicroPython the heap only shrinks when the collector runs, so each
+sample that is lower than the previous one counts as a collection, and
+the growth between samples adds up to the bytes allocated (a lower
+bound: what was allocated just before a collection is not seen). Under
+CPython tracemalloc supplies the heap size and exact peak, and
+gc.callbacks counts the collections.
+
+Samples are taken every millisecond. Neither thread allocates while
+sampling, so the figures are the firmware's own; a report is only built
+when one is requested. Every report covers the time since the previous
+one.
+"""
+
+import _thread
+import gc
+import json
+import socket
+import sys
+import time
+
+MICROPYTHON = sys.implementation.name == "micropython"
+
+# Indexes into _stats
+_START = 0  # ticks_ms of the last reset
+_LAST = 1  # Previous sample
+_PEAK = 2
+_MIN_FREE = 3
+_ALLOCATED = 4
+_COLLECTIONS = 5
+_SAMPLES = 6
+
+_stats = [0] * 7
+
+
+def _reset():
+    s = _stats
+    s[_START] = time.ticks_ms()
+    s[_LAST] = s[_PEAK] = gc.mem_alloc()
+    s[_MIN_FREE] = gc.mem_free()
+    s[_ALLOCATED] = s[_COLLECTIONS] = s[_SAMPLES] = 0
+    if not MICROPYTHON:
+        import tracemalloc
+
+        tracemalloc.reset_peak()
+
+
+def _sample():
+    s = _stats
+    while True:
+        used = gc.mem_alloc()
+        if used >= s[_LAST]:
+            s[_ALLOCATED] += used - s[_LAST]
+        elif MICROPYTHON:
+            s[_COLLECTIONS] += 1
+        s[_LAST] = used
+        if used > s[_PEAK]:
+            s[_PEAK] = used
+        free = gc.mem_free()
+        if free < s[_MIN_FREE]:
+            s[_MIN_FREE] = free
+        s[_SAMPLES] += 1
+        time.sleep_ms(1)
+
+
+def _on_gc(phase, info):
+    if phase == "start":
+        _stats[_COLLECTIONS] += 1
+
+
+def report():
+    """Heap figures since the previous report (or start())."""
+    s = _stats
+    elapsed = time.ticks_diff(time.ticks_ms(), s[_START])
+    peak = s[_PEAK]
+    if not MICROPYTHON:
+        import tracemalloc
+
+        peak = tracemalloc.get_traced_memory()[1]
+    out = {
+        "elapsed_ms": elapsed,
+        "heap_used": s[_LAST],
+        "peak_used": peak,
+        "allocated": s[_ALLOCATED],
+        "alloc_rate": s[_ALLOCATED] * 1000 // max(elapsed, 1),
+        "collections": s[_COLLECTIONS],
+        "samples": s[_SAMPLES],
+    }
+    if MICROPYTHON:
+        out["min_free"] = s[_MIN_FREE]
+    _reset()
+    return out
+
+
+def _serve(port):
+    server = socket.socket()
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(socket.getaddrinfo("127.0.0.1", port)[0][-1])
+    server.listen(1)
+    while True:
+        conn, _ = server.accept()
+        try:
+            conn.write(json.dumps(report()).encode())
+        finally:
+            conn.close()
+
+
+def start(port):
+    """Start sampling, and serve reports on 127.0.0.1:port."""
+    if not MICROPYTHON:
+        import tracemalloc
+
+        tracemalloc.start()
+        gc.callbacks.append(_on_gc)
+    _reset()
+    _thread.start_new_thread(_sample, ())
+    _thread.start_new_thread(_serve, (port,))
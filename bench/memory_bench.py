@@ -0,0 +1,270 @@
+"""
+Firmware Memory Footprint Benchmark
+===================================
+
+Runs both firmwares on the simulated board (run_firmware.py) under the
+MicroPython unix port with a fixed heap, replays a workload against them
+and records for each phase the peak heap, allocation rate and number of
+garbage collections (sampled in the firmware process by heapmon.py).
+
+WiFi firmware (against the fake broker from mqtt_harness.py):
+- idle: connected, publishing status every second, IN1 toggling
+- page: HTTP loads of the control page
+- poll: GET /api/status, as the page's refresh does
+- mqtt: relay, output and STATUS commands from the broker, back to back
+
+Serial firmware (over stdin):
+- idle: waiting for commands, IN1 toggling
+- poll: STATUS commands
+- commands: RELAY and OUTPUT commands, back to back
+
+A firmware that runs out of heap is reported with the phase it died in.
+Results are printed and written as JSON with the commit they were taken
+at; pass an earlier file as --baseline to print the change against it.
+
+The unix port's objects are larger than the board's (64-bit pointers)
+unless it is built with `make MICROPY_FORCE_32BIT=1`, so only compare
+results from the same build. Without micropython on the PATH (or with
+--python) the firmwares run under CPython with tracemalloc; the figures
+then only show trends, and there is no fixed heap.
+
+Usage:
+    make bench-memory
+    cd bench && python3 memory_bench.py [--heap 160k] [--json memory.json]
+                                        [--baseline old.json] [--python]
+"""
+
+import argparse
+import collections
+import json
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.request
+
+from mqtt_harness import FakeBroker, publish_packet
+
+PAGE_LOADS = 20
+STATUS_POLLS = 200
+MQTT_COMMANDS = 500
+SERIAL_COMMANDS = 500
+IDLE_S = 3
+INPUT_PERIOD_MS = 200
+
+
+def free_port():
+    s = socket.socket()
+    s.bind(("127.0.0.1", 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+def wait_until(cond, timeout_s=10):
+    deadline = time.monotonic() + timeout_s
+    while not cond():
+        if time.monotonic() > deadline:
+            raise TimeoutError
+        time.sleep(0.01)
+
+
+class Firmware:
+    """One firmware process on the simulated board, with a heap monitor."""
+
+    def __init__(self, name, interpreter, args):
+        self.name = name
+        self.stats_port = free_port()
+        self.flash = tempfile.mkdtemp(prefix=f"flash-{name}-")
+        cmd = interpreter + ["run_firmware.py", name, f"stats={self.stats_port}",
+                             f"flash={self.flash}", f"inputs={INPUT_PERIOD_MS},0,0,0"] + args
+        self.proc = subprocess.Popen(cmd, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT)
+        self.tail = collections.deque(maxlen=20)
+        self.counts = collections.Counter()  # Output lines by first word, "{" for JSON
+        threading.Thread(target=self._drain, daemon=True).start()
+
+    def _drain(self):
+        for line in self.proc.stdout:
+            line = line.decode(errors="replace").rstrip()
+            self.tail.append(line)
+            self.counts["{" if line.startswith("{") else line.split(" ", 1)[0]] += 1
+
+    def alive(self):
+        return self.proc.poll() is None
+
+    def stats(self):
+        with socket.create_connection(("127.0.0.1", self.stats_port), timeout=5) as s:
+            data = b""
+            while True:
+                chunk = s.recv(4096)
+                if not chunk:
+                    return json.loads(data)
+                data += chunk
+
+    def send(self, line):
+        self.proc.stdin.write(line.encode() + b"\n")
+        self.proc.stdin.flush()
+
+    def stop(self):
+        self.proc.kill()
+        self.proc.wait()
+        shutil.rmtree(self.flash, ignore_errors=True)
+
+
+def http_get(port, path):
+    with urllib.request.urlopen(f"http://127.0.0.1:{port}{path}", timeout=10) as r:
+        return r.read()
+
+
+def http_up(port):
+    try:
+        return http_get(port, "/api/status")
+    except OSError:
+        return False
+
+
+def run_phases(fw, phases):
+    """Run (name, action) phases, with a heap report after each."""
+    result = {"phases": {}, "died_in": None}
+    for name, action in phases:
+        try:
+            action()
+            result["phases"][name] = fw.stats()
+        except (OSError, TimeoutError, ValueError):
+            if fw.alive():
+                raise
+            result["died_in"] = name
+            result["output"] = list(fw.tail)
+            break
+    return result
+
+
+def bench_wifi(interpreter):
+    broker = FakeBroker()
+    http_port = free_port()
+    fw = Firmware("wifi", interpreter, [f"MQTT_PORT={broker.port}", f"HTTP_PORT={http_port}",
+                                        f"TCP_PORT={free_port()}", "MQTT_PUBLISH_INTERVAL=1000"])
+
+    def startup():
+        wait_until(lambda: (broker.count(0x80) and http_up(http_port)) or not fw.alive(), 20)
+
+    def page():
+        for _ in range(PAGE_LOADS):
+            http_get(http_port, "/")
+
+    def poll():
+        for _ in range(STATUS_POLLS):
+            http_get(http_port, "/api/status")
+
+    def mqtt():
+        before = fw.counts["MQTT:"]
+        for i in range(MQTT_COMMANDS):
+            if i % 10 == 9:
+                packet = publish_packet(b"automation/command", b"STATUS")
+            elif i % 2:
+                packet = publish_packet(b"automation/output/%d" % (i % 3 + 1), b"%d" % (i % 101))
+            else:
+                state = b"ON" if i % 4 else b"OFF"
+                packet = publish_packet(b"automation/relay/%d" % (i % 3 + 1), state)
+            broker.send(packet)
+        wait_until(lambda: fw.counts["MQTT:"] - before >= MQTT_COMMANDS or not fw.alive(), 60)
+
+    try:
+        return run_phases(fw, [("startup", startup), ("idle", lambda: time.sleep(IDLE_S)),
+                               ("page", page), ("poll", poll), ("mqtt", mqtt)])
+    finally:
+        fw.stop()
+        broker.close()
+
+
+def bench_serial(interpreter):
+    fw = Firmware("serial", interpreter, [])
+
+    def startup():
+        wait_until(lambda: fw.counts["#"] >= 3 or not fw.alive(), 20)
+
+    def commands(lines):
+        before = fw.counts["OK"] + fw.counts["{"]
+        for line in lines:
+            fw.send(line)
+        wait_until(lambda: fw.counts["OK"] + fw.counts["{"] - before >= len(lines)
+                   or not fw.alive(), 60)
+
+    def poll():
+        commands(["STATUS"] * STATUS_POLLS)
+
+    def flood():
+        commands([f"RELAY {i % 3 + 1} {'ON' if i % 4 else 'OFF'}" if i % 2 else
+                  f"OUTPUT {i % 3 + 1} {i % 101}" for i in range(SERIAL_COMMANDS)])
+
+    try:
+        return run_phases(fw, [("startup", startup), ("idle", lambda: time.sleep(IDLE_S)),
+                               ("poll", poll), ("commands", flood)])
+    finally:
+        fw.stop()
+
+
+def commit():
+    try:
+        return subprocess.check_output(["git", "describe", "--always", "--dirty"],
+                                       stderr=subprocess.DEVNULL, text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def print_results(results, baseline=None):
+    print(f"Memory footprint ({results['interpreter']}, heap {results['heap'] or '-'}, "
+          f"commit {results['commit']})")
+    print("-" * 80)
+    print(f"{'phase':<16}{'peak B':>10}{'min free B':>12}{'alloc B/s':>12}{'GCs':>6}"
+          f"{'peak vs base':>14}")
+    for firmware, result in results["firmware"].items():
+        base = (baseline or {}).get("firmware", {}).get(firmware, {}).get("phases", {})
+        for phase, s in result["phases"].items():
+            delta = ""
+            if phase in base:
+                delta = f"{s['peak_used'] - base[phase]['peak_used']:+d}"
+            print(f"{firmware + ' ' + phase:<16}{s['peak_used']:>10}{s.get('min_free', '-'):>12}"
+                  f"{s['alloc_rate']:>12}{s['collections']:>6}{delta:>14}")
+        if result["died_in"]:
+            print(f"{firmware}: exited during {result['died_in']}:")
+            for line in result["output"]:
+                print("    " + line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--heap", default="160k", help="unix port heap size (default 160k)")
+    parser.add_argument("--json", default="memory.json", help="results file")
+    parser.add_argument("--baseline", help="earlier results file to compare against")
+    parser.add_argument("--python", action="store_true", help="run the firmwares under CPython")
+    args = parser.parse_args()
+
+    if args.python or not shutil.which("micropython"):
+        interpreter = [sys.executable]
+        name, heap = "cpython", None
+    else:
+        interpreter = ["micropython", "-X", f"heapsize={args.heap}"]
+        name, heap = "micropython", args.heap
+
+    results = {"interpreter": name, "heap": heap, "commit": commit(),
+               "firmware": {"wifi": bench_wifi(interpreter),
+                            "serial": bench_serial(interpreter)}}
+
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    print_results(results, baseline)
+    with open(args.json, "w") as f:
+        json.dump(results, f, indent=2)
+    print(f"\nWritten to {args.json}")
+    return 1 if any(r["died_in"] for r in results["firmware"].values()) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
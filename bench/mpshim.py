@@ -0,0 +1,113 @@
+"""
+MicroPython Module Shims for CPython
+====================================
+
+Lets the firmware and its umqtt client run unmodified under CPython.
+install() registers usocket, uselect, uerrno, ustruct and utime with the
+MicroPython behaviour they rely on:
+
+- Sockets, including accepted ones, are streams: write() sends
+  everything, read(n) blocks until n bytes or EOF, and readinto() on a
+  non-blocking socket returns None when no data is waiting.
+- Poll objects have ipoll().
+- utime has ticks_ms/ticks_us/ticks_add/ticks_diff (starting from 0 at
+  install() and wrapping like the board's 30-bit ticks) and sleep_ms.
+- gc has mem_alloc() (bytes traced by tracemalloc, if running) and
+  mem_free() (0; CPython has no fixed heap).
+
+install(firmware=True) also puts the stream sockets under the plain
+socket module name, which the firmware itself imports.
+
+On MicroPython install() does nothing; the real modules are used.
+"""
+
+import sys
+
+MICROPYTHON = sys.implementation.name == "micropython"
+
+TICKS_PERIOD = 1 << 30
+TICKS_HALF = TICKS_PERIOD // 2
+
+
+def install(firmware=False):
+    if MICROPYTHON:
+        return
+    import errno
+    import gc
+    import select
+    import socket
+    import struct
+    import time
+    import tracemalloc
+    import types
+
+    class StreamSocket(socket.socket):
+        def write(self, data, n=None):
+            if n is not None:
+                data = memoryview(data)[:n]
+            self.sendall(data)
+            return len(data)
+
+        def read(self, n):
+            out = b""
+            while len(out) < n:
+                data = self.recv(n - len(out))
+                if not data:
+                    break
+                out += data
+            return out
+
+        def readinto(self, buf):
+            try:
+                return self.recv_into(buf)
+            except BlockingIOError:
+                return None
+
+        def accept(self):
+            fd, addr = self._accept()
+            sock = StreamSocket(self.family, self.type, self.proto, fileno=fd)
+            if socket.getdefaulttimeout() is None and self.gettimeout():
+                sock.setblocking(True)
+            return sock, addr
+
+    class Poll:
+        def __init__(self):
+            self._poll = select.poll()
+
+        def register(self, sock, mask=select.POLLIN | select.POLLOUT):
+            self._poll.register(sock, mask)
+
+        def modify(self, sock, mask):
+            self._poll.modify(sock, mask)
+
+        def unregister(self, sock):
+            self._poll.unregister(sock)
+
+        def poll(self, timeout=-1):
+            return self._poll.poll(timeout)
+
+        ipoll = poll
+
+    usocket = types.ModuleType("usocket")
+    usocket.__dict__.update((k, v) for k, v in vars(socket).items() if not k.startswith("__"))
+    usocket.socket = StreamSocket
+
+    uselect = types.ModuleType("uselect")
+    uselect.poll = Poll
+    for name in ("POLLIN", "POLLOUT", "POLLERR", "POLLHUP"):
+        setattr(uselect, name, getattr(select, name))
+
+    boot = time.perf_counter()  # Ticks count from 0 at "power on", like the board's
+    time.ticks_ms = lambda: int((time.perf_counter() - boot) * 1000) % TICKS_PERIOD
+    time.ticks_us = lambda: int((time.perf_counter() - boot) * 1000000) % TICKS_PERIOD
+    time.ticks_add = lambda t, delta: (t + delta) % TICKS_PERIOD
+    time.ticks_diff = lambda a, b: (a - b + TICKS_HALF) % TICKS_PERIOD - TICKS_HALF
+    time.sleep_ms = lambda ms: time.sleep(ms / 1000)
+
+    if not hasattr(gc, "mem_alloc"):
+        gc.mem_alloc = lambda: tracemalloc.get_traced_memory()[0] if tracemalloc.is_tracing() else 0
+        gc.mem_free = lambda: 0
+
+    sys.modules.update(uerrno=errno, uselect=uselect, usocket=usocket, ustruct=struct, utime=time)
+    if firmware:
+        sys.modules["socket"] = usocket
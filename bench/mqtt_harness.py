@@ -0,0 +1,517 @@
+"""
+MQTT Client Harness
+===================
+
+Runs the bundled umqtt.simple client off-target against an in-process
+fake broker, over real loopback sockets. First a set of scenarios checks
+the protocol handling the board depends on, then benchmarks measure it:
+
+Scenarios:
+- connect and batched subscribe, MQTT 3.1.1 and 5
+- incoming packets fragmented down to single bytes
+- large payloads in both directions, and an oversized incoming packet
+- QoS 1 retransmission after a lost PUBACK, QoS 2 in both directions
+  (including a duplicate PUBLISH before PUBREL)
+- broker misbehaviour: malformed length, refused subscription, closed
+  connection, missing PINGRESP
+
+Benchmarks:
+- publish throughput: QoS 0, blocking QoS 1, windowed QoS 1
+- parse cost per incoming packet, whole and fragmented
+- connect time: 3.1.1 with three SUBSCRIBEs, with one, and a resumed
+  MQTT 5 session
+
+Throughput and connect time are measured twice: over plain loopback,
+where only client CPU time counts, and with every broker reply delayed
+5 ms, where round trips dominate as they do over WiFi.
+
+Under CPython the MicroPython modules come from mpshim.py. On the
+MicroPython unix port the broker needs a build with _thread.
+
+Usage:
+    make bench-mqtt-harness
+    cd bench && python3 mqtt_harness.py
+"""
+
+import _thread
+import gc
+import socket
+import struct
+import sys
+import time
+
+import mpshim
+
+sys.path.append("../automation-firmware-wifi")
+mpshim.install()
+
+from umqtt.simple import MQTTClient, MQTTException  # noqa: E402
+
+STATUS = (
+    b'{"relays":[true,false,false],"outputs":[0.0,50.0,0.0],"inputs":[false,false,true,false],'
+    b'"adcs":[0.0,1.234,0.0],"buttons":{"a":false,"b":false},"version":"1.0.0",'
+    b'"wifi_connected":true,"mqtt_connected":true,"ip":"192.168.1.50"}'
+)
+FILTERS = ("automation/relay/+", "automation/output/+", "automation/command")
+
+failures = 0
+
+
+def put_len(n):
+    out = b""
+    while 1:
+        b = n & 0x7F
+        n >>= 7
+        if n:
+            out += bytes((b | 0x80,))
+        else:
+            return out + bytes((b,))
+
+
+def publish_packet(topic, payload, qos=0, pid=1, dup=False, version=4):
+    body = struct.pack("!H", len(topic)) + topic
+    if qos:
+        body += struct.pack("!H", pid)
+    if version == 5:
+        body += b"\x00"
+    body += payload
+    return bytes((0x30 | qos << 1 | dup << 3,)) + put_len(len(body)) + body
+
+
+class FakeBroker:
+    """
+    Accepts one client and answers it like a broker, with optional faults.
+
+    Args:
+        frag: Send every packet one byte at a time
+        drop_pubacks: Ignore this many QoS 1 publishes (no PUBACK)
+        pingresp: Answer PINGREQ
+        session_present: CONNACK session-present flag
+        alias_max: Topic Alias Maximum granted to MQTT 5 clients
+        refuse: Refuse every subscription (SUBACK 0x80)
+        latency_ms: Delay every reply, like a WiFi round trip
+    """
+
+    def __init__(self, frag=False, drop_pubacks=0, pingresp=True, session_present=False,
+                 alias_max=8, refuse=False, latency_ms=0):
+        self.frag = frag
+        self.latency_ms = latency_ms
+        self._delayed = []  # (due ticks_ms, data), sent by _deliver
+        self.drop_pubacks = drop_pubacks
+        self.pingresp = pingresp
+        self.session_present = session_present
+        self.alias_max = alias_max
+        self.refuse = refuse
+        self.received = []  # (type byte, body) of every client packet
+        self.delivered = []  # (topic, msg) passed to the client callback
+        self.version = 4
+        self.conn = None
+        self.closed = False
+        self.listener = socket.socket()
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(("127.0.0.1", 0))
+        self.listener.listen(1)
+        self.port = self.listener.getsockname()[1]
+        _thread.start_new_thread(self._serve, ())
+        if latency_ms:
+            _thread.start_new_thread(self._deliver, ())
+
+    def client(self, **kwargs):
+        c = MQTTClient("harness", "127.0.0.1", port=self.port, **kwargs)
+        c.set_callback(lambda topic, msg: self.delivered.append((topic, msg)))
+        return c
+
+    def count(self, kind):
+        return sum(1 for op, _ in self.received if op & 0xF0 == kind)
+
+    def send(self, data):
+        if self.latency_ms:
+            self._delayed.append((time.ticks_add(time.ticks_ms(), self.latency_ms), data))
+        else:
+            self._write(data)
+
+    def _deliver(self):
+        try:
+            while not self.closed:
+                if self._delayed and time.ticks_diff(time.ticks_ms(), self._delayed[0][0]) >= 0:
+                    self._write(self._delayed.pop(0)[1])
+                else:
+                    time.sleep_ms(1)
+        except OSError:
+            pass
+
+    def _write(self, data):
+        if self.frag:
+            for i in range(len(data)):
+                self.conn.sendall(data[i : i + 1])
+                time.sleep(0.0002)
+        else:
+            self.conn.sendall(data)
+
+    def close(self):
+        self.closed = True
+        for s in (self.conn, self.listener):
+            if s is not None:
+                try:
+                    s.close()
+                except OSError:
+                    pass
+
+    def _recv(self, n):
+        out = b""
+        while len(out) < n:
+            data = self.conn.recv(n - len(out))
+            if not data:
+                raise OSError("closed")
+            out += data
+        return out
+
+    def _serve(self):
+        try:
+            self.conn, _ = self.listener.accept()
+            while not self.closed:
+                op = self._recv(1)[0]
+                n = sh = 0
+                while 1:
+                    b = self._recv(1)[0]
+                    n |= (b & 0x7F) << sh
+                    if not b & 0x80:
+                        break
+                    sh += 7
+                body = self._recv(n)
+                self.received.append((op, body))
+                self._answer(op, body)
+        except OSError:
+            pass
+
+    def _answer(self, op, body):
+        kind = op & 0xF0
+        if kind == 0x10:  # CONNECT
+            self.version = body[6]
+            if self.version == 5:
+                self.send(b"\x20\x06" + bytes((self.session_present, 0, 3, 0x22, 0, self.alias_max)))
+            else:
+                self.send(bytes((0x20, 2, self.session_present, 0)))
+        elif kind == 0x80:  # SUBSCRIBE
+            i = 2
+            if self.version == 5:
+                i += 1 + body[2]
+            codes = b""
+            while i < len(body):
+                i += 2 + (body[i] << 8 | body[i + 1])
+                codes += b"\x80" if self.refuse else bytes((body[i],))
+                i += 1
+            head = body[:2] + (b"\x00" if self.version == 5 else b"")
+            self.send(bytes((0x90, len(head) + len(codes))) + head + codes)
+        elif kind == 0x30:  # PUBLISH
+            qos = op >> 1 & 3
+            if qos:
+                i = 2 + (body[0] << 8 | body[1])
+                pid = body[i : i + 2]
+                if qos == 2:
+                    self.send(b"\x50\x02" + pid)
+                elif self.drop_pubacks:
+                    self.drop_pubacks -= 1
+                else:
+                    self.send(b"\x40\x02" + pid)
+        elif kind == 0x60:  # PUBREL
+            self.send(b"\x70\x02" + body[:2])
+        elif kind == 0xC0:  # PINGREQ
+            if self.pingresp:
+                self.send(b"\xd0\x00")
+        elif kind == 0xE0:  # DISCONNECT
+            self.closed = True
+
+
+class ReplaySocket:
+    """Hands the client a prepared byte stream, chunk bytes per read."""
+
+    def __init__(self, data, chunk):
+        self.data = memoryview(data)
+        self.chunk = chunk
+        self.pos = 0
+
+    def readinto(self, buf):
+        n = min(len(buf), self.chunk, len(self.data) - self.pos)
+        if not n:
+            return None
+        buf[:n] = self.data[self.pos : self.pos + n]
+        self.pos += n
+        return n
+
+    def write(self, data, n=None):
+        return len(data) if n is None else n
+
+    def setblocking(self, flag):
+        pass
+
+
+def check(name, ok, detail=""):
+    global failures
+    if not ok:
+        failures += 1
+    print(f"  {'ok  ' if ok else 'FAIL'} {name}" + (f" ({detail})" if detail and not ok else ""))
+
+
+def wait_for(cond, c=None, timeout_ms=2000):
+    """Poll the client until cond() holds; returns whether it did."""
+    deadline = time.ticks_add(time.ticks_ms(), timeout_ms)
+    while not cond():
+        if time.ticks_diff(deadline, time.ticks_ms()) <= 0:
+            return False
+        if c is not None:
+            c.check_msg()
+        time.sleep_ms(1)
+    return True
+
+
+def raises(fn, exc):
+    try:
+        fn()
+    except exc:
+        return True
+    return False
+
+
+def drain_until_error(c, timeout_ms=2000):
+    # check_msg() until it raises; returns the exception or None
+    deadline = time.ticks_add(time.ticks_ms(), timeout_ms)
+    while time.ticks_diff(deadline, time.ticks_ms()) > 0:
+        try:
+            c.check_msg()
+        except Exception as e:
+            return e
+        time.sleep_ms(1)
+    return None
+
+
+# --- Scenarios ---
+
+
+def scenario_connect():
+    for version in (4, 5):
+        broker = FakeBroker()
+        c = broker.client(version=version)
+        present = c.connect()
+        c.subscribe(FILTERS, 1)
+        check(f"v{version} connect, 3 filters in one SUBSCRIBE",
+              present == 0 and broker.count(0x80) == 1 and c._suback_pid == c.pid)
+        if version == 5:
+            c.publish("automation/status", STATUS)
+            c.publish("automation/status", STATUS, qos=1)
+            first, second = (body for op, body in broker.received if op & 0xF0 == 0x30)
+            check("v5 topic alias replaces the repeated topic",
+                  second[:2] == b"\x00\x00" and len(second) < len(first))
+        broker.close()
+    broker = FakeBroker(session_present=True)
+    c = broker.client(version=5, session_expiry=600)
+    check("v5 resumed session reported", c.connect() == 1 and broker.received[0][1][7] & 2 == 0)
+    broker.close()
+
+
+def scenario_fragmented():
+    broker = FakeBroker(frag=True)
+    c = broker.client()
+    c.connect()
+    for i in range(20):
+        broker.send(publish_packet(b"automation/relay/1", b"ON%d" % i, qos=i % 2, pid=i + 1))
+    wait_for(lambda: len(broker.delivered) == 20, c, 5000)
+    check("20 publishes sent byte by byte all delivered",
+          [m for _, m in broker.delivered] == [b"ON%d" % i for i in range(20)],
+          f"{len(broker.delivered)} delivered")
+    check("PUBACK for each QoS 1 one", wait_for(lambda: broker.count(0x40) == 10))
+    broker.close()
+
+
+def scenario_large():
+    broker = FakeBroker()
+    c = broker.client(max_packet=4096)
+    c.connect()
+    big = bytes(range(256)) * 12  # 3072 bytes
+    c.publish("automation/status", big, qos=1)
+    check("3 KB publish sent (send buffer grows)",
+          broker.received[-1][0] & 0xF0 == 0x30 and broker.received[-1][1].endswith(big))
+    broker.send(publish_packet(b"automation/command", big))
+    check("3 KB publish received (receive buffer grows)",
+          wait_for(lambda: broker.delivered == [(b"automation/command", big)], c))
+    broker.send(publish_packet(b"automation/command", b"x" * 10000))
+    broker.send(publish_packet(b"automation/command", b"after"))
+    check("10 KB publish dropped, the next one delivered",
+          wait_for(lambda: len(broker.delivered) == 2, c) and c.dropped == 1
+          and broker.delivered[1][1] == b"after")
+    broker.close()
+
+
+def scenario_qos():
+    broker = FakeBroker(drop_pubacks=1)
+    c = broker.client(retry_ms=50)
+    c.connect()
+    pid = c.publish_nowait("automation/status", STATUS)
+    ok = wait_for(lambda: c.inflight == 0, c)
+    dups = [op for op, _ in broker.received if op & 0xF0 == 0x30 and op & 0x08]
+    check("lost PUBACK: resent with DUP, then acked",
+          pid and ok and len(dups) == 1 and c.retransmits == 1 and c.acked == 1)
+    broker.close()
+
+    broker = FakeBroker()
+    c = broker.client()
+    c.connect()
+    c.publish("automation/status", STATUS, qos=2)
+    check("QoS 2 publish: PUBLISH, PUBREL, done",
+          broker.count(0x30) == 1 and broker.count(0x60) == 1 and c.inflight == 0)
+    pkt = publish_packet(b"automation/relay/2", b"OFF", qos=2, pid=7)
+    broker.send(pkt)
+    wait_for(lambda: broker.count(0x50) == 1, c)
+    broker.send(bytes((pkt[0] | 0x08,)) + pkt[1:])  # Resent before PUBREL
+    wait_for(lambda: broker.count(0x50) == 2, c)
+    broker.send(b"\x62\x02\x00\x07")
+    check("incoming QoS 2 duplicate delivered once, PUBCOMP sent",
+          wait_for(lambda: broker.count(0x70) == 1, c) and len(broker.delivered) == 1)
+    broker.close()
+
+    broker = FakeBroker(drop_pubacks=2, alias_max=4)
+    c = broker.client(version=5, session_expiry=600, retry_ms=50)
+    c.connect()
+    c.publish_nowait("automation/status", STATUS)
+    c.publish_nowait("automation/status", STATUS)
+    time.sleep_ms(100)
+    c.check_msg()
+    check("v5: no resend on a live connection", broker.count(0x30) == 2 and c.retransmits == 0)
+    broker.close()
+    broker = FakeBroker(session_present=True, alias_max=4)
+    c.port = broker.port
+    c.connect()
+    resent = [body for op, body in broker.received if op & 0xF0 == 0x30 and op & 0x08]
+    check("v5 resumed session: in-flight resent with DUP, aliases set up again",
+          wait_for(lambda: c.inflight == 0, c) and len(resent) == 2
+          and resent[0][:2] != b"\x00\x00" and resent[1][:2] == b"\x00\x00")
+    broker.close()
+
+
+def scenario_misbehaviour():
+    broker = FakeBroker()
+    c = broker.client()
+    c.connect()
+    broker.send(b"\x30\xff\xff\xff\xff\x01")
+    check("malformed remaining length raises", isinstance(drain_until_error(c), MQTTException))
+    broker.close()
+
+    broker = FakeBroker(refuse=True)
+    c = broker.client()
+    c.connect()
+    check("refused subscription raises", raises(lambda: c.subscribe("automation/#"), MQTTException))
+    broker.close()
+
+    broker = FakeBroker()
+    c = broker.client()
+    c.connect()
+    broker.conn.shutdown(socket.SHUT_RDWR)
+    check("closed connection raises", isinstance(drain_until_error(c), OSError))
+    broker.close()
+
+    broker = FakeBroker(pingresp=False)
+    c = broker.client(keepalive=1, ping_timeout_ms=300)
+    c.connect()
+    start = time.ticks_ms()
+    err = drain_until_error(c, 3000)
+    elapsed = time.ticks_diff(time.ticks_ms(), start)
+    check("missing PINGRESP detected", isinstance(err, OSError) and c.pings == 1 and elapsed < 1500,
+          f"{elapsed} ms")
+    broker.close()
+
+
+# --- Benchmarks ---
+
+
+def bench_publish(rounds, latency_ms):
+    print(f"\nPublish throughput, broker replies after {latency_ms} ms ({rounds} status publishes)")
+    for name, kwargs, send in (
+        ("QoS 0", {}, lambda c: c.publish("automation/status", STATUS)),
+        ("QoS 1 blocking", {}, lambda c: c.publish("automation/status", STATUS, qos=1)),
+        ("QoS 1 window 4", {"window": 4}, None),
+        ("QoS 1 window 16", {"window": 16}, None),
+    ):
+        broker = FakeBroker(latency_ms=latency_ms)
+        c = broker.client(**kwargs)
+        c.connect()
+        start = time.ticks_us()
+        for _ in range(rounds):
+            if send:
+                send(c)
+            else:
+                while c.publish_nowait("automation/status", STATUS) is None:
+                    c.wait_msg()  # Window full: wait for an ack
+        while c.inflight:
+            c.wait_msg()
+        elapsed = time.ticks_diff(time.ticks_us(), start)
+        while broker.count(0x30) < rounds:
+            time.sleep_ms(1)
+        print(f"  {name:<18} {rounds * 1000000 / elapsed:9.0f} /s")
+        broker.close()
+
+
+def bench_parse(count=1000):
+    print(f"\nParse cost per incoming packet ({count} packets, check_msg)")
+    handled = []
+    for payload in (b"ON", STATUS):
+        stream = publish_packet(b"automation/relay/1", payload, qos=0) * count
+        for chunk in (1536, 64, 1):
+            handled.clear()
+            c = MQTTClient("harness", "127.0.0.1")
+            c.set_callback(lambda topic, msg: handled.append(1))
+            c.sock = ReplaySocket(stream, chunk)
+            gc.collect()
+            start = time.ticks_us()
+            while c.check_msg() is not None:
+                pass
+            elapsed = time.ticks_diff(time.ticks_us(), start)
+            if len(handled) != count:
+                check(f"{len(payload)}-byte payloads in {chunk}-byte reads", False)
+            print(f"  {len(payload):4d}-byte payload, {chunk:4d}-byte reads "
+                  f"{elapsed / count:8.1f} us")
+
+
+def bench_connect(rounds, latency_ms):
+    print(f"\nConnect time, broker replies after {latency_ms} ms (mean of {rounds})")
+    for name, kwargs, present, batch in (
+        ("3.1.1, 3 SUBSCRIBE", {}, False, False),
+        ("3.1.1, 1 SUBSCRIBE", {}, False, True),
+        ("5, 1 SUBSCRIBE", {"version": 5}, False, True),
+        ("5, resumed session", {"version": 5, "session_expiry": 600}, True, True),
+    ):
+        total = 0
+        for _ in range(rounds):
+            broker = FakeBroker(session_present=present, latency_ms=latency_ms)
+            c = broker.client(**kwargs)
+            start = time.ticks_us()
+            if not c.connect():
+                if batch:
+                    c.subscribe(FILTERS)
+                else:
+                    for f in FILTERS:
+                        c.subscribe(f)
+            total += time.ticks_diff(time.ticks_us(), start)
+            broker.close()
+        print(f"  {name:<20} {total / rounds / 1000:7.2f} ms   {len(broker.received)} packets")
+
+
+def main():
+    print(f"{sys.implementation.name}\n\nScenarios")
+    scenario_connect()
+    scenario_fragmented()
+    scenario_large()
+    scenario_qos()
+    scenario_misbehaviour()
+    bench_publish(2000, 0)
+    bench_publish(200, 5)
+    bench_parse()
+    bench_connect(50, 0)
+    bench_connect(20, 5)
+    if failures:
+        print(f"\n{failures} scenario check(s) failed")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,124 @@
+"""
+MQTT Publish Benchmark
+======================
+
+Measures the bundled umqtt.simple client sending to a socket that only
+counts: publishes per second (client CPU cost, no network) and socket
+writes per packet. On lwIP every write to an idle connection goes out as
+its own TCP segment, so writes per publish is the segment count the
+broker sees.
+
+The MQTT 5 rows assume the broker granted topic aliases. The "setup"
+rows are the packets the firmware sends per (re)connect: CONNECT plus
+its subscriptions, one SUBSCRIBE per filter or one for all three, or
+none when an MQTT 5 session is resumed.
+
+Runs on the MicroPython unix port (also reports heap bytes allocated per
+publish) and under CPython.
+
+Usage:
+    make bench-mqtt
+    cd bench && micropython mqtt_publish_bench.py
+"""
+
+import gc
+import sys
+import time
+
+import mpshim
+
+sys.path.append("../automation-firmware-wifi")
+
+MICROPYTHON = mpshim.MICROPYTHON
+mpshim.install()  # The client imports the MicroPython module names
+
+from umqtt.simple import MQTTClient  # noqa: E402
+
+ROUNDS = 5000
+TOPIC = "automation/status"
+STATUS = (
+    b'{"relays":[true,false,false],"outputs":[0.0,50.0,0.0],"inputs":[false,false,true,false],'
+    b'"adcs":[0.0,1.234,0.0],"buttons":{"a":false,"b":false},"version":"1.0.0",'
+    b'"wifi_connected":true,"mqtt_connected":true,"ip":"192.168.1.50"}'
+)
+EDGE = b'{"state":"HIGH","count":17,"ticks_us":123456789}'
+
+
+class CountingSocket:
+    """Accepts every write and counts calls and bytes."""
+
+    def __init__(self):
+        self.writes = 0
+        self.bytes = 0
+
+    def write(self, data, n=None):
+        n = len(data) if n is None else n
+        self.writes += 1
+        self.bytes += n
+        return n
+
+    def setblocking(self, flag):
+        pass
+
+
+def ticks_us():
+    if MICROPYTHON:
+        return time.ticks_us()
+    return int(time.perf_counter() * 1000000)
+
+
+def client(version):
+    c = MQTTClient("bench", "127.0.0.1", version=version, session_expiry=3600 if version == 5 else 0)
+    c.sock = CountingSocket()
+    c.set_callback(lambda topic, msg: None)
+    c.alias_max = c.topic_aliases  # As granted in the CONNACK
+    return c
+
+
+FILTERS = ("automation/relay/+", "automation/output/+", "automation/command")
+
+
+def setup(c, filters):
+    c._send_connect(None)
+    for f in filters:
+        c._send_subscribe(f, 0)
+
+
+def measure(name, fn, version=4):
+    c = client(version)
+    fn(c)  # Warm up
+    c.sock = sock = CountingSocket()
+    gc.collect()
+    if MICROPYTHON:
+        gc.disable()
+        before = gc.mem_alloc()
+    start = ticks_us()
+    for _ in range(ROUNDS):
+        fn(c)
+    elapsed = ticks_us() - start
+    line = (f"{name:<24} {ROUNDS * 1000000 / elapsed:9.0f} /s"
+            f"   {sock.writes / ROUNDS:4.1f} writes"
+            f"   {sock.bytes / ROUNDS:6.1f} bytes")
+    if MICROPYTHON:
+        line += f"   {(gc.mem_alloc() - before) / ROUNDS:6.1f} bytes allocated"
+        gc.enable()
+    print(line)
+
+
+def main():
+    print(f"{sys.implementation.name}, {ROUNDS} packets each\n")
+    measure("publish status", lambda c: c.publish(TOPIC, STATUS))
+    measure("publish status (str)", lambda c: c.publish(TOPIC, STATUS.decode()))
+    measure("publish edge", lambda c: c.publish("automation/input/1", EDGE))
+    measure("subscribe", lambda c: c._send_subscribe("automation/relay/+", 0))
+    measure("connect", lambda c: c._send_connect(True))
+    measure("publish status (5)", lambda c: c.publish(TOPIC, STATUS), 5)
+    measure("publish edge (5)", lambda c: c.publish("automation/input/1", EDGE), 5)
+    measure("setup, 3 SUBSCRIBE", lambda c: setup(c, FILTERS))
+    measure("setup, 1 SUBSCRIBE", lambda c: setup(c, (FILTERS,)))
+    measure("setup, 1 SUBSCRIBE (5)", lambda c: setup(c, (FILTERS,)), 5)
+    measure("setup, resumed (5)", lambda c: setup(c, ()), 5)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,141 @@
+"""
+Run the Firmware on Linux
+=========================
+
+Runs the unmodified serial or WiFi firmware on the host, with the
+stand-in hardware in hal/: simulated relays, outputs, inputs and ADC
+waveforms (hal/sim.py), and a WLAN that "connects" to the host network,
+so the HTTP, TCP, MQTT and telemetry sockets are real host sockets.
+
+Works under CPython (through mpshim.py) and the MicroPython unix port,
+where the .py files in hal/ take the place of the built-in machine
+module. Use it for profiling, memory measurement and protocol
+benchmarks against a local broker or HTTP client.
+
+The WiFi firmware starts from config.py.example with the HTTP server on
+port 8080 and the broker on 127.0.0.1; any NAME=value argument overrides
+a config setting. Files it writes (config.json, data log, OTA state) go
+to flash-wifi/ (flash-serial/ for the serial firmware), which stands in
+for the board's filesystem.
+
+Runner options:
+    inputs=P1,P2,P3,P4   Square wave period per input in ms (0 = static)
+    flash=DIR            Filesystem directory instead of flash-<firmware>/
+    stats=PORT           Sample the heap and serve reports on this port
+                         (heapmon.py, used by memory_bench.py)
+
+Usage:
+    cd bench
+    python3 run_firmware.py wifi HTTP_PORT=8080 MQTT_BROKER=127.0.0.1 inputs=500,0,0,0
+    echo "RELAY 1 ON" | micropython run_firmware.py serial
+"""
+
+import os
+import sys
+
+BENCH = os.getcwd()
+sys.path.insert(0, BENCH + "/hal")
+
+import mpshim  # noqa: E402
+
+mpshim.install(firmware=True)
+
+import sim  # noqa: E402
+
+DEFAULTS = {"HTTP_PORT": 8080, "MQTT_BROKER": "127.0.0.1"}
+
+
+def parse_value(text):
+    if text in ("True", "False"):
+        return text == "True"
+    try:
+        return int(text)
+    except ValueError:
+        pass
+    try:
+        return float(text)
+    except ValueError:
+        return text
+
+
+def load_config(firmware_dir, overrides):
+    """config module from config.py.example, with overrides applied."""
+    values = {}
+    with open(firmware_dir + "/config.py.example") as f:
+        exec(f.read(), values)
+    values.update(overrides)
+
+    class config:
+        pass
+
+    for name, value in values.items():
+        if not name.startswith("__"):
+            setattr(config, name, value)
+    sys.modules["config"] = config
+
+
+class RawStdin:
+    """Unbuffered stdin for CPython, so poll() and read(1) agree like on the board."""
+
+    def fileno(self):
+        return 0
+
+    def read(self, n):
+        data = os.read(0, n)
+        if not data:
+            raise SystemExit(0)  # Input closed
+        return data.decode()
+
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] not in ("wifi", "serial"):
+        print(__doc__)
+        return 2
+    firmware = sys.argv[1]
+    overrides = dict(DEFAULTS)
+    flash = f"{BENCH}/flash-{firmware}"
+    stats_port = None
+    for arg in sys.argv[2:]:
+        name, _, value = arg.partition("=")
+        if name == "inputs":
+            for i, period in enumerate(value.split(",")):
+                sim.input_period_ms[i] = int(period)
+        elif name == "flash":
+            flash = value
+        elif name == "stats":
+            stats_port = int(value)
+        else:
+            overrides[name] = parse_value(value)
+
+    firmware_dir = f"{BENCH}/../automation-firmware-{firmware}"
+    sys.path.insert(1, firmware_dir)
+    sys.path.insert(2, BENCH + "/../automation-firmware-core")
+    if firmware == "wifi":
+        load_config(firmware_dir, overrides)
+
+    try:
+        os.mkdir(flash)
+    except OSError:
+        pass  # Kept from the previous run, like the board's flash
+    os.chdir(flash)
+
+    if not mpshim.MICROPYTHON:
+        sys.stdin = RawStdin()
+        sys.stdout.reconfigure(line_buffering=True)
+
+    if stats_port:
+        import heapmon
+
+        heapmon.start(stats_port)
+    sim.start()
+    import main as firmware_main
+
+    if firmware == "wifi":
+        firmware_main.AutomationController().run()
+    else:
+        firmware_main.AutomationController(board_type="standard").run()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
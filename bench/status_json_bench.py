@@ -0,0 +1,109 @@
+"""
+Status JSON Encoder Benchmark
+=============================
+
+Compares the old status path (status() dict + json.dumps) with the
+allocation-free StatusEncoder. Run on the MicroPython unix port, where
+it measures heap bytes allocated per call and verifies the encoder
+under micropython.heap_lock(), which raises MemoryError on any
+allocation. Under CPython only the timings are printed.
+
+Usage:
+    make bench-json
+    cd bench && micropython status_json_bench.py
+"""
+
+import gc
+import json
+import sys
+import time
+
+sys.path.append("hal")
+sys.path.append("../automation-firmware-core")
+
+from automation import Automation2040W  # noqa: E402 - stand-in from hal/
+from automation_core import AutomationCore  # noqa: E402
+from status_json import StatusEncoder  # noqa: E402
+
+ROUNDS = 500
+MICROPYTHON = sys.implementation.name == "micropython"
+
+
+class FakeADC:
+    """Raw 16-bit reading, as machine.ADC.read_u16() returns on the board."""
+
+    def __init__(self, raw):
+        self.raw = raw
+
+    def read_u16(self):
+        return self.raw
+
+
+def ticks_us():
+    if MICROPYTHON:
+        return time.ticks_us()
+    return int(time.perf_counter() * 1000000)
+
+
+def measure(name, fn):
+    fn()  # Warm up caches
+    gc.collect()
+    if MICROPYTHON:
+        gc.disable()
+        before = gc.mem_alloc()
+    start = ticks_us()
+    for _ in range(ROUNDS):
+        fn()
+    elapsed = ticks_us() - start
+    line = f"{name:<34} {elapsed / ROUNDS:8.1f} us/call"
+    if MICROPYTHON:
+        line += f"   {(gc.mem_alloc() - before) / ROUNDS:8.1f} bytes allocated/call"
+        gc.enable()
+    print(line)
+
+
+def heap_locked(fn):
+    """True if fn() runs ROUNDS times without a single heap allocation."""
+    import micropython
+
+    fn()
+    micropython.heap_lock()
+    try:
+        for _ in range(ROUNDS):
+            fn()
+        return True
+    except MemoryError:
+        return False
+    finally:
+        micropython.heap_unlock()
+
+
+def main():
+    board = Automation2040W()
+    core = AutomationCore(board, "bench")
+    core.encoder = StatusEncoder(core, adcs=[FakeADC(12000), FakeADC(30500), FakeADC(65535)])
+    core.set_relay(1, True)
+    core.set_output(0, 0.5)
+    core.set_output(2, 0.333)
+    extra = b',"ip":"192.168.1.50"'
+
+    print(f"{sys.implementation.name} {sys.version}, {ROUNDS} rounds")
+    print(bytes(core.encoder.encode(extra)).decode())
+    print("-" * 80)
+
+    def old():
+        status = core.status()
+        status["ip"] = "192.168.1.50"
+        return json.dumps(status)
+
+    measure("status() + json.dumps()", old)
+    measure("StatusEncoder.encode()", lambda: core.encoder.encode(extra))
+
+    if MICROPYTHON:
+        ok = heap_locked(lambda: core.encoder.encode(extra))
+        print(f"StatusEncoder under heap_lock(): {'no allocations' if ok else 'ALLOCATES'}")
+        if not ok:
+            sys.exit(1)
+
+
+main()
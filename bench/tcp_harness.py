@@ -0,0 +1,130 @@
+"""
+TCP Command Server Harness
+==========================
+
+Runs the WiFi firmware's line-protocol server (tcp_server.py) off-target
+on the simulated board, polled in-process like the main loop does, with
+clients on real loopback sockets. Checks:
+
+- pipelined commands answered in order in one reply
+- a command split over several packets
+- bytes that are not valid UTF-8: ERR, and the client stays connected
+- an overlong line: ERR, and the buffer is discarded
+- connections beyond max_clients are closed
+
+Exits non-zero if a check fails.
+
+Usage:
+    make bench-tcp-harness
+    cd bench && python3 tcp_harness.py
+"""
+
+import socket
+import sys
+import time
+
+import mpshim
+
+sys.path.append("hal")
+sys.path.append("../automation-firmware-core")
+sys.path.append("../automation-firmware-wifi")
+mpshim.install()
+
+from automation import Automation2040W  # noqa: E402 - stand-in from hal/
+from automation_core import AutomationCore  # noqa: E402
+from tcp_server import TextServer  # noqa: E402
+
+failures = 0
+
+
+def check(name, ok, detail=""):
+    global failures
+    if not ok:
+        failures += 1
+    print(f"  {'ok  ' if ok else 'FAIL'} {name}" + (f" ({detail})" if detail and not ok else ""))
+
+
+def free_port():
+    s = socket.socket()
+    s.bind(("127.0.0.1", 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+
+def connect(server, port):
+    c = socket.create_connection(("127.0.0.1", port), timeout=2)
+    for _ in range(100):
+        server.poll()
+        if server.clients or c.fileno() < 0:
+            break
+        time.sleep(0.001)
+    return c
+
+
+def exchange(server, c, data, lines, timeout_s=2):
+    """Send data, poll the server and return the first `lines` reply lines."""
+    c.sendall(data)
+    reply = b""
+    deadline = time.monotonic() + timeout_s
+    c.setblocking(False)
+    try:
+        while reply.count(b"\n") < lines and time.monotonic() < deadline:
+            server.poll()
+            try:
+                chunk = c.recv(4096)
+                if not chunk:
+                    break
+                reply += chunk
+            except BlockingIOError:
+                time.sleep(0.001)
+    finally:
+        c.setblocking(True)
+    return reply.decode(errors="replace").split("\n")[:lines]
+
+
+def main():
+    print(f"{sys.implementation.name}\n\nScenarios")
+    core = AutomationCore(Automation2040W(), "harness")
+    port = free_port()
+    server = TextServer(core, port, max_clients=2)
+
+    c = connect(server, port)
+    reply = exchange(server, c, b"RELAY 1 ON\nPING\nRELAY 1 OFF\n", 3)
+    check("pipelined commands answered in order", reply == ["OK", "OK PONG", "OK"], reply)
+
+    c.sendall(b"PI")
+    server.poll()
+    reply = exchange(server, c, b"NG\n", 1)
+    check("command split over two packets", reply == ["OK PONG"], reply)
+
+    reply = exchange(server, c, b"RELAY \xff\xfe ON\nPING\n", 2)
+    check("invalid UTF-8: ERR, next line still served",
+          reply[0].startswith("ERR") and reply[1] == "OK PONG", reply)
+    check("invalid UTF-8: client stays connected", len(server.clients) == 1)
+
+    reply = exchange(server, c, b"X" * 300, 1)
+    check("overlong line: ERR", reply[0] == "ERR Line too long", reply)
+    reply = exchange(server, c, b"\nPING\n", 1)
+    check("overlong line: buffer discarded", reply == ["OK PONG"], reply)
+
+    c2 = connect(server, port)
+    c3 = connect(server, port)
+    c3.settimeout(1)
+    try:
+        closed = c3.recv(1) == b""
+    except OSError:
+        closed = True
+    check("connection beyond max_clients closed", closed and len(server.clients) == 2)
+
+    for s in (c, c2, c3):
+        s.close()
+    server.sock.close()
+    if failures:
+        print(f"\n{failures} scenario check(s) failed")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())